@@ -0,0 +1,74 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "bench_stubs.h"
+
+/*
+ * Counts heap allocations of the whole process by interposing the libc
+ * allocator, which also catches allocations made inside GLib and the C
+ * library on behalf of the bridge.
+ */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static atomic_uint_fast64_t allocations;
+static __thread bool counting_paused;
+
+static inline void alloc_count(void)
+{
+    if (!counting_paused)
+    {
+        atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    }
+}
+
+void *malloc(size_t size)
+{
+    alloc_count();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    alloc_count();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    alloc_count();
+    return __libc_realloc(ptr, size);
+}
+
+void alloc_count_pause(bool paused)
+{
+    counting_paused = paused;
+}
+
+void alloc_count_reset(void)
+{
+    atomic_store(&allocations, 0);
+}
+
+uint64_t alloc_count_get(void)
+{
+    return atomic_load(&allocations);
+}
@@ -0,0 +1,1217 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <netinet/in.h>
+#include <open62541/client_config_default.h>
+#include <open62541/client_highlevel.h>
+#include <open62541/client_subscriptions.h>
+#include <open62541/plugin/log_stdout.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../opcua_evqueue.h"
+#include "../opcua_export.h"
+#include "../opcua_latency.h"
+#include "../opcua_log.h"
+#include "../opcua_profiles.h"
+#include "bench_stubs.h"
+
+/*
+ * Host benchmark of the alarm path: the bridge runs unmodified on top of
+ * the axevent/axparameter stubs, a generator fires events across a number
+ * of profiles and local OPC UA clients, one by default, monitor every
+ * profile node.
+ * Latency is measured end to end, from the event time stamp to the arrival
+ * of the data change notification carrying it as source timestamp.
+ */
+
+#define BENCH_APP_NAME "opcuavmdev"
+#define BENCH_LABEL_SIZE 64
+#define BENCH_STARTUP_TIMEOUT_S 10
+#define BENCH_SETTLE_MS 200
+#define BENCH_IDLE_MS 1000
+#define BENCH_CLIENTS_MAX 256
+
+// opcua_vmdev.c is built with its main renamed
+int opcuavmdev_main(int argc, char **argv);
+
+static gint rate = 1000;
+static gint profile_count = 16;
+static gchar *sources = "VMD";
+static gint duration_s = 10;
+static gint drain_ms = 1000;
+static gint port = 48400;
+static gdouble publish_ms = 0;
+static gdouble sample_ms = 0;
+static gint queue_size = 1;
+static gint client_count = 1;
+static gchar *manifest = "manifest.json";
+static gchar **overrides;
+static gchar *pubsub_url;
+static gchar *export_path;
+static gint rebind_port;
+static gboolean undeclare;
+
+static GOptionEntry entries[] = {
+    {"rate", 'r', 0, G_OPTION_ARG_INT, &rate, "Events per second, 0 for as fast as possible", "N"},
+    {"profiles", 'n', 0, G_OPTION_ARG_INT, &profile_count, "Number of profiles to fire events for", "N"},
+    {"sources", 's', 0, G_OPTION_ARG_STRING, &sources, "Comma separated event sources", "LIST"},
+    {"duration", 'd', 0, G_OPTION_ARG_INT, &duration_s, "Seconds to generate events", "S"},
+    {"drain", 0, 0, G_OPTION_ARG_INT, &drain_ms, "Milliseconds to wait for late notifications", "MS"},
+    {"port", 'p', 0, G_OPTION_ARG_INT, &port, "OPC UA server port", "PORT"},
+    {"publish-ms", 0, 0, G_OPTION_ARG_DOUBLE, &publish_ms, "Requested publishing interval", "MS"},
+    {"sample-ms", 0, 0, G_OPTION_ARG_DOUBLE, &sample_ms, "Requested sampling interval", "MS"},
+    {"queue", 'q', 0, G_OPTION_ARG_INT, &queue_size, "Requested monitored item queue size", "N"},
+    {"clients", 'c', 0, G_OPTION_ARG_INT, &client_count, "Number of clients monitoring every profile", "N"},
+    {"manifest", 'm', 0, G_OPTION_ARG_FILENAME, &manifest, "Manifest holding the parameter defaults", "FILE"},
+    {"param", 'P', 0, G_OPTION_ARG_STRING_ARRAY, &overrides, "Override a parameter", "NAME=VALUE"},
+    {"pubsub", 0, 0, G_OPTION_ARG_STRING, &pubsub_url, "Publish to and count a UADP address", "opc.udp://ADDR:PORT/"},
+    {"export", 0, 0, G_OPTION_ARG_FILENAME, &export_path, "Export to and read from a Unix socket", "PATH"},
+    {"undeclare", 0, 0, G_OPTION_ARG_NONE, &undeclare, "Declare the profiles, drop the last one after the run", NULL},
+    {"rebind", 0, 0, G_OPTION_ARG_INT, &rebind_port, "Move the server to PORT after the run and reconnect", "PORT"},
+    {NULL}};
+
+typedef struct
+{
+    const gchar *source;
+    gchar label[BENCH_LABEL_SIZE];
+    gchar node[PROFILES_SOURCE_NAME_SIZE + BENCH_LABEL_SIZE];
+    gboolean active;
+} bench_profile_t;
+
+static bench_profile_t *profiles;
+static gchar **source_names;
+
+// Every client runs in a thread of its own and owns its entry until joined
+typedef struct
+{
+    pthread_t thread;
+    gint index;
+    uint32_t *samples;
+    size_t sample_count;
+    size_t sample_capacity;
+    uint64_t notifications;
+    int64_t cpu_ns;
+} bench_client_t;
+
+static bench_client_t *clients;
+
+// Merged from all clients once they are joined
+static uint32_t *samples;
+static size_t sample_count;
+static uint64_t notifications;
+static int64_t client_cpu_ns;
+
+static atomic_int clients_ready;
+static atomic_bool client_failed;
+static atomic_bool client_stop;
+static atomic_bool measuring;
+static atomic_bool listener_stop;
+static atomic_bool warmed_up;
+
+// Owned by the main loop while generating
+static struct
+{
+    int64_t start_ns;
+    int64_t end_ns;
+    uint64_t sent;
+    atomic_bool done;
+} generator;
+
+// Owned by the PubSub listener thread until it is joined
+static uint64_t pubsub_messages;
+static atomic_uint_least64_t pubsub_received;
+static uint64_t pubsub_bytes;
+static int64_t listener_cpu_ns;
+static UA_DateTime measure_start;
+
+// Owned by the export reader thread until it is joined
+static uint32_t *export_samples;
+static size_t export_count;
+static size_t export_capacity;
+static uint32_t export_dropped;
+static atomic_bool export_reader_stop;
+static int app_result;
+
+static int64_t bench_cpu_ns(clockid_t clock)
+{
+    struct timespec now;
+
+    clock_gettime(clock, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void *bench_app(void *data)
+{
+    char *argv[] = {BENCH_APP_NAME, NULL};
+
+    (void)data;
+
+    app_result = opcuavmdev_main(1, argv);
+    return NULL;
+}
+
+static void bench_data_change(
+    UA_Client *client,
+    UA_UInt32 sub_id,
+    void *sub_context,
+    UA_UInt32 mon_id,
+    void *mon_context,
+    UA_DataValue *value)
+{
+    bench_client_t *bench = sub_context;
+    UA_DateTime now = UA_DateTime_now();
+
+    (void)client;
+    (void)sub_id;
+    (void)mon_id;
+    (void)mon_context;
+
+    if (!atomic_load(&measuring) || !value->hasSourceTimestamp || value->sourceTimestamp < measure_start)
+    {
+        return;
+    }
+
+    bench->notifications++;
+    if (bench->sample_count == bench->sample_capacity)
+    {
+        bench->sample_capacity = (0 == bench->sample_capacity) ? 4096 : 2 * bench->sample_capacity;
+        bench->samples = realloc(bench->samples, bench->sample_capacity * sizeof(*bench->samples));
+        assert(NULL != bench->samples);
+    }
+
+    int64_t us = (now - value->sourceTimestamp) / UA_DATETIME_USEC;
+    bench->samples[bench->sample_count++] = (0 > us) ? 0 : (uint32_t)MIN(us, UINT32_MAX);
+}
+
+static gboolean bench_client_setup(UA_Client *client, bench_client_t *bench)
+{
+    UA_DateTime deadline = UA_DateTime_nowMonotonic() + BENCH_STARTUP_TIMEOUT_S * UA_DATETIME_SEC;
+    gchar *url = g_strdup_printf("opc.tcp://localhost:%d", port);
+    UA_StatusCode status;
+
+    // The server thread may still be starting
+    while (UA_STATUSCODE_GOOD != (status = UA_Client_connect(client, url)) && UA_DateTime_nowMonotonic() < deadline)
+    {
+        g_usleep(100000);
+    }
+    g_free(url);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        fprintf(stderr, "Cannot connect to port %d: %s\n", port, UA_StatusCode_name(status));
+        return FALSE;
+    }
+
+    // Nodes are created by the first event of each profile
+    for (gint i = 0; i < profile_count; i++)
+    {
+        for (;;)
+        {
+            UA_Variant value;
+
+            UA_Variant_init(&value);
+            status = UA_Client_readValueAttribute(client, UA_NODEID_STRING(1, profiles[i].node), &value);
+            UA_Variant_clear(&value);
+            if (UA_STATUSCODE_GOOD == status || UA_DateTime_nowMonotonic() > deadline)
+            {
+                break;
+            }
+            g_usleep(10000);
+        }
+
+        if (UA_STATUSCODE_GOOD != status)
+        {
+            fprintf(stderr, "No node '%s': %s\n", profiles[i].node, UA_StatusCode_name(status));
+            return FALSE;
+        }
+    }
+
+    UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
+    request.requestedPublishingInterval = publish_ms;
+    UA_CreateSubscriptionResponse response = UA_Client_Subscriptions_create(client, request, bench, NULL, NULL);
+    if (UA_STATUSCODE_GOOD != response.responseHeader.serviceResult)
+    {
+        fprintf(stderr, "Cannot create subscription: %s\n", UA_StatusCode_name(response.responseHeader.serviceResult));
+        return FALSE;
+    }
+
+    for (gint i = 0; i < profile_count; i++)
+    {
+        UA_NodeId node_id = UA_NODEID_STRING(1, profiles[i].node);
+        UA_MonitoredItemCreateRequest item = UA_MonitoredItemCreateRequest_default(node_id);
+        item.requestedParameters.samplingInterval = sample_ms;
+        item.requestedParameters.queueSize = queue_size;
+
+        UA_MonitoredItemCreateResult result = UA_Client_MonitoredItems_createDataChange(
+            client,
+            response.subscriptionId,
+            UA_TIMESTAMPSTORETURN_SOURCE,
+            item,
+            NULL,
+            bench_data_change,
+            NULL);
+        if (UA_STATUSCODE_GOOD != result.statusCode)
+        {
+            fprintf(stderr, "Cannot monitor '%s': %s\n", profiles[i].node, UA_StatusCode_name(result.statusCode));
+            return FALSE;
+        }
+    }
+
+    if (0 == bench->index)
+    {
+        printf(
+            "Monitoring %d nodes from %d clients, publishing interval %.1f ms (requested %.1f ms)\n",
+            profile_count,
+            client_count,
+            response.revisedPublishingInterval,
+            publish_ms);
+    }
+
+    // Let the initial notifications pass before measuring
+    UA_DateTime settled = UA_DateTime_nowMonotonic() + BENCH_SETTLE_MS * UA_DATETIME_MSEC;
+    while (UA_DateTime_nowMonotonic() < settled)
+    {
+        (void)UA_Client_run_iterate(client, 10);
+    }
+
+    return TRUE;
+}
+
+static void *bench_client(void *data)
+{
+    bench_client_t *bench = data;
+    UA_Client *client;
+
+    // The client's own work is not part of the bridge's cost
+    alloc_count_pause(true);
+
+    client = UA_Client_new();
+    UA_ClientConfig *config = UA_Client_getConfig(client);
+    UA_ClientConfig_setDefault(config);
+    config->logger = UA_Log_Stdout_withLevel(UA_LOGLEVEL_WARNING);
+
+    if (!bench_client_setup(client, bench))
+    {
+        atomic_store(&client_failed, true);
+        UA_Client_delete(client);
+        return NULL;
+    }
+
+    atomic_fetch_add(&clients_ready, 1);
+    int64_t cpu_start_ns = bench_cpu_ns(CLOCK_THREAD_CPUTIME_ID);
+    while (!atomic_load(&client_stop))
+    {
+        (void)UA_Client_run_iterate(client, 10);
+    }
+    bench->cpu_ns = bench_cpu_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start_ns;
+
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+    return NULL;
+}
+
+static gboolean bench_clients_start(void)
+{
+    clients = g_new0(bench_client_t, client_count);
+    for (gint i = 0; i < client_count; i++)
+    {
+        clients[i].index = i;
+        if (0 != pthread_create(&clients[i].thread, NULL, bench_client, &clients[i]))
+        {
+            client_count = i;
+            atomic_store(&client_failed, true);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void bench_clients_join(void)
+{
+    size_t count = 0;
+
+    atomic_store(&client_stop, true);
+    for (gint i = 0; i < client_count; i++)
+    {
+        pthread_join(clients[i].thread, NULL);
+        notifications += clients[i].notifications;
+        client_cpu_ns += clients[i].cpu_ns;
+        count += clients[i].sample_count;
+    }
+
+    // The latency percentiles are taken over the notifications of all clients
+    samples = malloc(MAX(count, 1) * sizeof(*samples));
+    assert(NULL != samples);
+    for (gint i = 0; i < client_count; i++)
+    {
+        memcpy(samples + sample_count, clients[i].samples, clients[i].sample_count * sizeof(*samples));
+        sample_count += clients[i].sample_count;
+        free(clients[i].samples);
+    }
+    g_free(clients);
+}
+
+static int bench_listener_open(void)
+{
+    char host[64];
+    unsigned int udp_port;
+    struct sockaddr_in address = {0};
+    struct timeval timeout = {0, 100000};
+    int one = 1;
+    int fd;
+
+    if (2 != sscanf(pubsub_url, "opc.udp://%63[^:]:%u", host, &udp_port) || 65535 < udp_port ||
+        1 != inet_pton(AF_INET, host, &address.sin_addr))
+    {
+        fprintf(stderr, "Cannot listen on '%s', expected opc.udp://ADDR:PORT/\n", pubsub_url);
+        return -1;
+    }
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (0 > fd)
+    {
+        return -1;
+    }
+
+    // Share the port with any other subscriber on this host
+    struct ip_mreq group = {address.sin_addr, {htonl(INADDR_ANY)}};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(udp_port);
+    (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    (void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (IN_MULTICAST(ntohl(address.sin_addr.s_addr)))
+    {
+        (void)setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group));
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+    if (0 != bind(fd, (struct sockaddr *)&address, sizeof(address)))
+    {
+        perror("Cannot bind PubSub listener");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void *bench_listener(void *data)
+{
+    int fd = *(int *)data;
+    char message[65536];
+
+    alloc_count_pause(true);
+    int64_t cpu_start_ns = bench_cpu_ns(CLOCK_THREAD_CPUTIME_ID);
+    while (!atomic_load(&listener_stop))
+    {
+        ssize_t size = recv(fd, message, sizeof(message), 0);
+
+        if (0 < size)
+        {
+            atomic_fetch_add(&pubsub_received, 1);
+        }
+        if (0 < size && atomic_load(&measuring))
+        {
+            pubsub_messages++;
+            pubsub_bytes += size;
+        }
+    }
+    listener_cpu_ns = bench_cpu_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start_ns;
+    close(fd);
+    return NULL;
+}
+
+static int bench_export_open(void)
+{
+    struct sockaddr_un address = {0};
+    struct timeval timeout = {0, 100000};
+    int64_t deadline_ns = latency_now_ns() + BENCH_STARTUP_TIMEOUT_S * 1000000000LL;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+
+    if (0 > fd)
+    {
+        return -1;
+    }
+
+    address.sun_family = AF_UNIX;
+    g_strlcpy(address.sun_path, export_path, sizeof(address.sun_path));
+    while (0 != connect(fd, (struct sockaddr *)&address, sizeof(address)))
+    {
+        if (latency_now_ns() > deadline_ns)
+        {
+            perror("Cannot connect to the export socket");
+            close(fd);
+            return -1;
+        }
+        g_usleep(10000);
+    }
+    (void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    return fd;
+}
+
+static void *bench_export_reader(void *data)
+{
+    int fd = *(int *)data;
+    union
+    {
+        uint8_t kind;
+        export_record_t record;
+        export_profile_t profile;
+    } message;
+
+    alloc_count_pause(true);
+    while (!atomic_load(&export_reader_stop))
+    {
+        ssize_t size = recv(fd, &message, sizeof(message), 0);
+        int64_t start_us = (measure_start - UA_DATETIME_UNIX_EPOCH) / UA_DATETIME_USEC;
+
+        if (sizeof(export_record_t) != size || EXPORT_TRANSITION != message.kind || !atomic_load(&measuring) ||
+            message.record.timestamp < start_us)
+        {
+            continue;
+        }
+
+        if (export_count == export_capacity)
+        {
+            export_capacity = (0 == export_capacity) ? 4096 : 2 * export_capacity;
+            export_samples = realloc(export_samples, export_capacity * sizeof(*export_samples));
+            assert(NULL != export_samples);
+        }
+        int64_t us = g_get_real_time() - message.record.timestamp;
+        export_samples[export_count++] = (0 > us) ? 0 : (uint32_t)MIN(us, UINT32_MAX);
+        export_dropped = message.record.dropped;
+    }
+    close(fd);
+    return NULL;
+}
+
+static gboolean bench_setup_profiles(void)
+{
+    guint source_count;
+
+    source_names = g_strsplit(sources, ",", -1);
+    source_count = g_strv_length(source_names);
+    for (guint i = 0; i < source_count; i++)
+    {
+        g_strstrip(source_names[i]);
+    }
+    if (0 == source_count || 0 >= profile_count || PROFILES_MAX < profile_count)
+    {
+        fprintf(stderr, "Need at least one source and 1 to %d profiles\n", PROFILES_MAX);
+        return FALSE;
+    }
+
+    // Profiles are spread round robin over the sources
+    profiles = g_new0(bench_profile_t, profile_count);
+    for (gint i = 0; i < profile_count; i++)
+    {
+        bench_profile_t *profile = &profiles[i];
+
+        profile->source = source_names[i % source_count];
+        g_snprintf(profile->label, sizeof(profile->label), "Camera1Profile%u", i / source_count);
+        g_snprintf(profile->node, sizeof(profile->node), "%s.%s", profile->source, profile->label);
+    }
+
+    return TRUE;
+}
+
+static gboolean bench_wait_subscribed(void)
+{
+    gint64 deadline = g_get_monotonic_time() + BENCH_STARTUP_TIMEOUT_S * G_USEC_PER_SEC;
+
+    for (gchar **name = source_names; NULL != *name; name++)
+    {
+        while (!stub_axevent_subscribed(*name))
+        {
+            if (g_get_monotonic_time() > deadline)
+            {
+                fprintf(stderr, "No subscription for source '%s'\n", *name);
+                return FALSE;
+            }
+            g_usleep(10000);
+        }
+    }
+    return TRUE;
+}
+
+static double bench_wait_connectable(int64_t launched_ns)
+{
+    struct sockaddr_in address = {0};
+    int64_t deadline_ns = launched_ns + BENCH_STARTUP_TIMEOUT_S * 1000000000LL;
+
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // A plain TCP connect, so that the time is not spent in the client stack
+    while (latency_now_ns() < deadline_ns)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int result = (0 > fd) ? -1 : connect(fd, (struct sockaddr *)&address, sizeof(address));
+
+        if (0 <= fd)
+        {
+            close(fd);
+        }
+        if (0 == result)
+        {
+            return (latency_now_ns() - launched_ns) / 1e6;
+        }
+        g_usleep(1000);
+    }
+    fprintf(stderr, "Port %d not connectable\n", port);
+    return -1.0;
+}
+
+static gint bench_count_nodes(void)
+{
+    UA_Client *client = UA_Client_new();
+    gchar *url = g_strdup_printf("opc.tcp://localhost:%d", port);
+    gint present = 0;
+
+    UA_ClientConfig_setDefault(UA_Client_getConfig(client));
+    UA_Client_getConfig(client)->logger = UA_Log_Stdout_withLevel(UA_LOGLEVEL_WARNING);
+
+    // Nodes that exist before any event was fired were restored from a snapshot
+    if (UA_STATUSCODE_GOOD == UA_Client_connect(client, url))
+    {
+        for (gint i = 0; i < profile_count; i++)
+        {
+            UA_Variant value;
+
+            UA_Variant_init(&value);
+            if (UA_STATUSCODE_GOOD ==
+                UA_Client_readValueAttribute(client, UA_NODEID_STRING(1, profiles[i].node), &value))
+            {
+                present++;
+            }
+            UA_Variant_clear(&value);
+        }
+        UA_Client_disconnect(client);
+    }
+    UA_Client_delete(client);
+    g_free(url);
+
+    return present;
+}
+
+static gboolean bench_sweep(double *reads_ms, double *call_ms, size_t *call_profiles)
+{
+    UA_Client *client = UA_Client_new();
+    gchar *url = g_strdup_printf("opc.tcp://localhost:%d", port);
+    UA_Variant *outputs = NULL;
+    size_t output_count = 0;
+    UA_StatusCode status;
+
+    UA_ClientConfig_setDefault(UA_Client_getConfig(client));
+    UA_Client_getConfig(client)->logger = UA_Log_Stdout_withLevel(UA_LOGLEVEL_WARNING);
+    status = UA_Client_connect(client, url);
+    g_free(url);
+
+    // What a poller needs for a consistent picture: one read per profile,
+    // or a single GetSnapshot call
+    int64_t start_ns = latency_now_ns();
+    for (gint i = 0; i < profile_count && UA_STATUSCODE_GOOD == status; i++)
+    {
+        UA_Variant value;
+
+        UA_Variant_init(&value);
+        status = UA_Client_readValueAttribute(client, UA_NODEID_STRING(1, profiles[i].node), &value);
+        UA_Variant_clear(&value);
+    }
+    *reads_ms = (latency_now_ns() - start_ns) / 1e6;
+
+    start_ns = latency_now_ns();
+    if (UA_STATUSCODE_GOOD == status)
+    {
+        status = UA_Client_call(
+            client,
+            UA_NODEID_STRING(1, "Bridge"),
+            UA_NODEID_STRING(1, "Bridge.GetSnapshot"),
+            0,
+            NULL,
+            &output_count,
+            &outputs);
+    }
+    *call_ms = (latency_now_ns() - start_ns) / 1e6;
+    *call_profiles = (0 < output_count) ? outputs[0].arrayLength : 0;
+    UA_Array_delete(outputs, output_count, &UA_TYPES[UA_TYPES_VARIANT]);
+
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        fprintf(stderr, "Cannot sweep the profiles: %s\n", UA_StatusCode_name(status));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// The declared set, optionally without the last profile
+static gchar *bench_declared(gint count)
+{
+    GString *spec = g_string_new(NULL);
+
+    for (gint i = 0; i < count; i++)
+    {
+        g_string_append_printf(spec, "%s%s", 0 == i ? "" : ",", profiles[i].node);
+    }
+    return g_string_free(spec, FALSE);
+}
+
+static gboolean bench_undeclare_start(gpointer data)
+{
+    gchar *spec = bench_declared(profile_count - 1);
+
+    (void)data;
+    stub_axparameter_set("eventprofiles", spec);
+    g_free(spec);
+    return G_SOURCE_REMOVE;
+}
+
+// Drops the last profile from the declared set. Its node has to disappear,
+// the others have to stay and PubSub has to keep publishing the rest.
+static gboolean bench_undeclare(void)
+{
+    gint64 deadline = g_get_monotonic_time() + BENCH_STARTUP_TIMEOUT_S * G_USEC_PER_SEC;
+    uint64_t published = 0;
+    gboolean removed = FALSE;
+    UA_Client *client = UA_Client_new();
+    gchar *url = g_strdup_printf("opc.tcp://localhost:%d", port);
+    UA_StatusCode dropped = UA_STATUSCODE_GOOD;
+    UA_StatusCode kept = UA_STATUSCODE_GOOD;
+    gboolean publishing = (NULL == pubsub_url);
+
+    (void)g_idle_add(bench_undeclare_start, NULL);
+    UA_ClientConfig_setDefault(UA_Client_getConfig(client));
+    UA_Client_getConfig(client)->logger = UA_Log_Stdout_withLevel(UA_LOGLEVEL_WARNING);
+    UA_StatusCode status = UA_Client_connect(client, url);
+    g_free(url);
+    while (UA_STATUSCODE_GOOD == status && g_get_monotonic_time() < deadline)
+    {
+        UA_Variant value;
+
+        g_usleep(BENCH_SETTLE_MS * 1000);
+        UA_Variant_init(&value);
+        dropped = UA_Client_readValueAttribute(client, UA_NODEID_STRING(1, profiles[profile_count - 1].node), &value);
+        UA_Variant_clear(&value);
+        kept = UA_Client_readValueAttribute(client, UA_NODEID_STRING(1, profiles[0].node), &value);
+        UA_Variant_clear(&value);
+
+        if (UA_STATUSCODE_BADNODEIDUNKNOWN != dropped)
+        {
+            continue;
+        }
+
+        // Messages counted from the removal on come from the rebuilt data set
+        if (!removed)
+        {
+            removed = TRUE;
+            published = atomic_load(&pubsub_received);
+            continue;
+        }
+        publishing = publishing || atomic_load(&pubsub_received) > published;
+        if (publishing)
+        {
+            break;
+        }
+    }
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+
+    printf(
+        "undeclare            dropped %s is %s, kept %s is %s, pubsub %s\n",
+        profiles[profile_count - 1].node,
+        UA_StatusCode_name(dropped),
+        profiles[0].node,
+        UA_StatusCode_name(kept),
+        NULL == pubsub_url ? "off" : (publishing ? "publishing" : "silent"));
+    return UA_STATUSCODE_GOOD == status && UA_STATUSCODE_BADNODEIDUNKNOWN == dropped &&
+           UA_STATUSCODE_GOOD == kept && publishing;
+}
+
+static gboolean bench_rebind_start(gpointer data)
+{
+    gchar *value = g_strdup_printf("%d", rebind_port);
+
+    (void)data;
+
+    // Changed from the main loop, where the camera calls parameter callbacks
+    stub_axparameter_set("port", value);
+    g_free(value);
+    return G_SOURCE_REMOVE;
+}
+
+// Moves the server to the rebind port and reconnects, returns the number of
+// profiles whose node kept the last fired state or -1 when not reachable
+static gint bench_rebind(double *rebind_ms)
+{
+    int64_t start_ns = latency_now_ns();
+    UA_Client *client;
+    gchar *url;
+    gint kept = 0;
+
+    port = rebind_port;
+    (void)g_idle_add(bench_rebind_start, NULL);
+    if (0 > (*rebind_ms = bench_wait_connectable(start_ns)))
+    {
+        return -1;
+    }
+
+    client = UA_Client_new();
+    url = g_strdup_printf("opc.tcp://localhost:%d", port);
+    UA_ClientConfig_setDefault(UA_Client_getConfig(client));
+    UA_Client_getConfig(client)->logger = UA_Log_Stdout_withLevel(UA_LOGLEVEL_WARNING);
+    UA_StatusCode status = UA_Client_connect(client, url);
+    g_free(url);
+    for (gint i = 0; i < profile_count && UA_STATUSCODE_GOOD == status; i++)
+    {
+        UA_Variant value;
+
+        UA_Variant_init(&value);
+        status = UA_Client_readValueAttribute(client, UA_NODEID_STRING(1, profiles[i].node), &value);
+        if (UA_STATUSCODE_GOOD == status && UA_Variant_hasScalarType(&value, &UA_TYPES[UA_TYPES_BOOLEAN]) &&
+            *(UA_Boolean *)value.data == profiles[i].active)
+        {
+            kept++;
+        }
+        UA_Variant_clear(&value);
+    }
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        fprintf(stderr, "Cannot read the profiles after the rebind: %s\n", UA_StatusCode_name(status));
+        return -1;
+    }
+    return kept;
+}
+
+static void bench_fire_next(void)
+{
+    bench_profile_t *profile = &profiles[generator.sent % profile_count];
+
+    profile->active = !profile->active;
+    (void)stub_axevent_fire(profile->source, profile->label, profile->active, g_get_real_time());
+    generator.sent++;
+}
+
+static gboolean bench_tick(gpointer data)
+{
+    int64_t now_ns = latency_now_ns();
+
+    (void)data;
+
+    if (0 < rate)
+    {
+        // Everything due since the last tick goes out in one main loop dispatch
+        uint64_t due = (uint64_t)((MIN(now_ns, generator.end_ns) - generator.start_ns) * rate / 1000000000);
+
+        while (generator.sent < due)
+        {
+            bench_fire_next();
+        }
+    }
+    else
+    {
+        // As fast as possible, giving the main loop a turn every millisecond
+        int64_t yield_ns = MIN(now_ns + 1000000, generator.end_ns);
+
+        while (latency_now_ns() < yield_ns)
+        {
+            bench_fire_next();
+        }
+    }
+
+    if (latency_now_ns() >= generator.end_ns)
+    {
+        atomic_store(&generator.done, true);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static uint64_t bench_generate(void)
+{
+    generator.start_ns = latency_now_ns();
+    generator.end_ns = generator.start_ns + (int64_t)duration_s * 1000000000;
+
+    // Events are fired from the bridge's main loop, where the SDK dispatches them
+    if (0 < rate)
+    {
+        (void)g_timeout_add(1, bench_tick, NULL);
+    }
+    else
+    {
+        (void)g_idle_add(bench_tick, NULL);
+    }
+    while (!atomic_load(&generator.done))
+    {
+        g_usleep(1000);
+    }
+
+    return generator.sent;
+}
+
+static gboolean bench_warmup(gpointer data)
+{
+    (void)data;
+
+    // One event per profile makes the bridge create its node
+    for (gint i = 0; i < profile_count; i++)
+    {
+        (void)stub_axevent_fire(profiles[i].source, profiles[i].label, FALSE, g_get_real_time());
+    }
+    atomic_store(&warmed_up, true);
+    return G_SOURCE_REMOVE;
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint32_t bench_percentile(const uint32_t *values, size_t count, double percentile)
+{
+    if (0 == count)
+    {
+        return 0;
+    }
+    return values[(size_t)(percentile / 100.0 * (count - 1))];
+}
+
+static long bench_status_kb(const char *field)
+{
+    char line[256];
+    long value = -1;
+    size_t length = strlen(field);
+    FILE *status = fopen("/proc/self/status", "r");
+
+    if (NULL == status)
+    {
+        return -1;
+    }
+    while (NULL != fgets(line, sizeof(line), status))
+    {
+        if (0 == strncmp(line, field, length) && ':' == line[length])
+        {
+            value = strtol(line + length + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(status);
+
+    return value;
+}
+
+int main(int argc, char **argv)
+{
+    GOptionContext *context = g_option_context_new("- benchmark the OPC UA alarm path on the host");
+    GError *error = NULL;
+    pthread_t app_thread;
+    pthread_t listener_thread;
+    pthread_t export_thread;
+    int listener_fd = -1;
+    int export_fd = -1;
+    double startup_ms;
+    double sweep_reads_ms;
+    double sweep_call_ms;
+    size_t sweep_profiles;
+    gint restored_nodes;
+    gint rebind_kept = 0;
+    double rebind_ms = 0;
+    evqueue_stats_t queue;
+    log_stats_t log;
+
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        fprintf(stderr, "%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(context);
+
+    if (0 >= client_count || BENCH_CLIENTS_MAX < client_count)
+    {
+        fprintf(stderr, "Need 1 to %d clients\n", BENCH_CLIENTS_MAX);
+        return EXIT_FAILURE;
+    }
+    if (!bench_setup_profiles())
+    {
+        return EXIT_FAILURE;
+    }
+    if (undeclare && 2 > profile_count)
+    {
+        fprintf(stderr, "Need at least 2 profiles to undeclare one\n");
+        return EXIT_FAILURE;
+    }
+
+    // Keep the bridge quiet, then apply overrides before the manifest defaults
+    gchar *port_value = g_strdup_printf("%d", port);
+    stub_axparameter_set("port", port_value);
+    stub_axparameter_set("eventsource", sources);
+    stub_axparameter_set("loglevel", "Error");
+    stub_axparameter_set("eventlograte", "0");
+    stub_axparameter_set("snapshotfile", "");
+    if (NULL != pubsub_url)
+    {
+        stub_axparameter_set("pubsuburl", pubsub_url);
+    }
+    if (NULL != export_path)
+    {
+        stub_axparameter_set("exportsocket", export_path);
+    }
+    g_free(port_value);
+    if (undeclare)
+    {
+        gchar *spec = bench_declared(profile_count);
+
+        stub_axparameter_set("eventprofiles", spec);
+        g_free(spec);
+    }
+    for (gchar **override = overrides; NULL != override && NULL != *override; override++)
+    {
+        gchar **pair = g_strsplit(*override, "=", 2);
+
+        if (NULL == pair[0] || NULL == pair[1])
+        {
+            fprintf(stderr, "Bad parameter override '%s'\n", *override);
+            return EXIT_FAILURE;
+        }
+        stub_axparameter_set(pair[0], pair[1]);
+        g_strfreev(pair);
+    }
+    if (!stub_axparameter_load_manifest(manifest))
+    {
+        fprintf(stderr, "Cannot read parameters from '%s'\n", manifest);
+        return EXIT_FAILURE;
+    }
+
+    int64_t launched_ns = latency_now_ns();
+    if (0 != pthread_create(&app_thread, NULL, bench_app, NULL) ||
+        0 > (startup_ms = bench_wait_connectable(launched_ns)) || !bench_wait_subscribed())
+    {
+        return EXIT_FAILURE;
+    }
+    restored_nodes = bench_count_nodes();
+
+    (void)g_idle_add(bench_warmup, NULL);
+    while (!atomic_load(&warmed_up))
+    {
+        g_usleep(1000);
+    }
+
+    // What the bridge holds before any client connects
+    long base_kb = bench_status_kb("VmRSS");
+    (void)bench_clients_start();
+
+    // A plain UDP socket counts what a PubSub subscriber on this host gets
+    if (NULL != pubsub_url &&
+        (0 > (listener_fd = bench_listener_open()) ||
+         0 != pthread_create(&listener_thread, NULL, bench_listener, &listener_fd)))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // A local consumer of the change stream, next to the OPC UA clients
+    if (NULL != export_path &&
+        (0 > (export_fd = bench_export_open()) ||
+         0 != pthread_create(&export_thread, NULL, bench_export_reader, &export_fd)))
+    {
+        return EXIT_FAILURE;
+    }
+    while (atomic_load(&clients_ready) < client_count && !atomic_load(&client_failed))
+    {
+        g_usleep(10000);
+    }
+    if (atomic_load(&client_failed) || !bench_sweep(&sweep_reads_ms, &sweep_call_ms, &sweep_profiles))
+    {
+        bench_clients_join();
+        kill(getpid(), SIGTERM);
+        pthread_join(app_thread, NULL);
+        return EXIT_FAILURE;
+    }
+
+    // What the bridge and the connected client cost while nothing happens
+    int64_t idle_cpu_ns = bench_cpu_ns(CLOCK_PROCESS_CPUTIME_ID);
+    g_usleep(BENCH_IDLE_MS * 1000);
+    idle_cpu_ns = bench_cpu_ns(CLOCK_PROCESS_CPUTIME_ID) - idle_cpu_ns;
+
+    printf("Firing %d events/s across %d profiles for %d s\n", rate, profile_count, duration_s);
+    measure_start = UA_DateTime_now();
+    atomic_store(&measuring, true);
+    alloc_count_reset();
+
+    int64_t start_ns = latency_now_ns();
+    int64_t cpu_start_ns = bench_cpu_ns(CLOCK_PROCESS_CPUTIME_ID);
+    uint64_t sent = bench_generate();
+    double elapsed_s = (latency_now_ns() - start_ns) / 1e9;
+
+    g_usleep(drain_ms * 1000);
+    int64_t cpu_ns = bench_cpu_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu_start_ns;
+    uint64_t allocations = alloc_count_get();
+    atomic_store(&measuring, false);
+    bench_clients_join();
+
+    // Checked while the PubSub listener still runs
+    if (undeclare && !bench_undeclare())
+    {
+        app_result = -1;
+    }
+    if (0 <= listener_fd)
+    {
+        atomic_store(&listener_stop, true);
+        pthread_join(listener_thread, NULL);
+    }
+    if (0 <= export_fd)
+    {
+        atomic_store(&export_reader_stop, true);
+        pthread_join(export_thread, NULL);
+    }
+
+    long rss_kb = bench_status_kb("VmRSS");
+    long peak_kb = bench_status_kb("VmHWM");
+
+    // A port change restarts the server, every profile must come back as it was
+    if (0 != rebind_port && 0 > (rebind_kept = bench_rebind(&rebind_ms)))
+    {
+        app_result = -1;
+    }
+
+    // Stop the bridge the way the camera does, its statistics are stable after that
+    int64_t stop_ns = latency_now_ns();
+    kill(getpid(), SIGTERM);
+    pthread_join(app_thread, NULL);
+    double shutdown_ms = (latency_now_ns() - stop_ns) / 1e6;
+    evqueue_get_stats(&queue);
+    log_get_stats(&log);
+
+    qsort(samples, sample_count, sizeof(*samples), bench_compare);
+    qsort(export_samples, export_count, sizeof(*export_samples), bench_compare);
+
+    printf("\n");
+    printf(
+        "startup ms           %.1f to connectable, %d of %d nodes restored\n",
+        startup_ms,
+        restored_nodes,
+        profile_count);
+    printf("shutdown ms          %.1f\n", shutdown_ms);
+    if (0 != rebind_port)
+    {
+        printf(
+            "rebind ms            %.1f to connectable on port %d, %d of %d states kept\n",
+            rebind_ms,
+            rebind_port,
+            rebind_kept,
+            profile_count);
+        if (rebind_kept != profile_count)
+        {
+            app_result = -1;
+        }
+    }
+    printf(
+        "sweep ms             %.2f for %d reads, %.2f for one call returning %zu profiles\n",
+        sweep_reads_ms,
+        profile_count,
+        sweep_call_ms,
+        sweep_profiles);
+    printf("events fired         %llu (%.0f/s)\n", (unsigned long long)sent, sent / elapsed_s);
+    printf(
+        "events queued        %llu, dropped %llu, highwater %zu\n",
+        (unsigned long long)queue.pushed,
+        (unsigned long long)queue.dropped,
+        queue.highwater);
+    printf(
+        "notifications        %llu (%.0f/s) to %d clients\n",
+        (unsigned long long)notifications,
+        notifications / (elapsed_s + drain_ms / 1000.0),
+        client_count);
+    printf(
+        "latency us           p50 %u p99 %u p999 %u max %u\n",
+        bench_percentile(samples, sample_count, 50.0),
+        bench_percentile(samples, sample_count, 99.0),
+        bench_percentile(samples, sample_count, 99.9),
+        0 == sample_count ? 0 : samples[sample_count - 1]);
+    for (int stage = 0; stage < LATENCY_STAGES; stage++)
+    {
+        static const char *names[LATENCY_STAGES] = {"event", "queue", "iterate"};
+
+        printf(
+            "  %-8s stage us  p50 <%llu p99 <%llu p999 <%llu\n",
+            names[stage],
+            (unsigned long long)latency_percentile(stage, 50.0),
+            (unsigned long long)latency_percentile(stage, 99.0),
+            (unsigned long long)latency_percentile(stage, 99.9));
+    }
+    if (NULL != pubsub_url)
+    {
+        printf(
+            "pubsub messages      %llu (%.0f/s), %llu bytes\n",
+            (unsigned long long)pubsub_messages,
+            pubsub_messages / (elapsed_s + drain_ms / 1000.0),
+            (unsigned long long)pubsub_bytes);
+    }
+    if (NULL != export_path)
+    {
+        printf(
+            "export us            p50 %u p99 %u p999 %u max %u, %zu records, %u dropped\n",
+            bench_percentile(export_samples, export_count, 50.0),
+            bench_percentile(export_samples, export_count, 99.0),
+            bench_percentile(export_samples, export_count, 99.9),
+            0 == export_count ? 0 : export_samples[export_count - 1],
+            export_count,
+            export_dropped);
+    }
+    // Everything but the client and the listener is the bridge and the event generator standing in for the SDK
+    double wall_ns = (elapsed_s + drain_ms / 1000.0) * 1e9;
+    int64_t bridge_cpu_ns = cpu_ns - client_cpu_ns - listener_cpu_ns;
+    printf(
+        "cpu %%                bridge %.1f, clients %.1f, all idle %.2f\n",
+        100.0 * bridge_cpu_ns / wall_ns,
+        100.0 * client_cpu_ns / wall_ns,
+        100.0 * idle_cpu_ns / (BENCH_IDLE_MS * 1e6));
+    printf(
+        "cpu us/notification  bridge %.2f\n",
+        0 == notifications ? 0.0 : bridge_cpu_ns / 1e3 / notifications);
+    // The clients live in the same process, their memory is included
+    printf("rss kB               %ld, peak %ld, %ld before clients\n", rss_kb, peak_kb, base_kb);
+    printf("allocations/event    %.2f\n", 0 == sent ? 0.0 : (double)allocations / sent);
+    printf(
+        "log lines            written %llu, dropped %llu, suppressed %llu\n",
+        (unsigned long long)log.written,
+        (unsigned long long)log.dropped,
+        (unsigned long long)log.suppressed);
+
+    free(samples);
+    free(export_samples);
+    g_free(profiles);
+    g_strfreev(source_names);
+
+    return 0 == app_result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
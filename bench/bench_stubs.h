@@ -0,0 +1,44 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _BENCH_STUBS_H_
+#define _BENCH_STUBS_H_
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Control side of the host stubs, used by the benchmark harness to drive
+ * the bridge as if it was running on a camera.
+ */
+
+// Parameters start from the manifest defaults, set overrides them and calls
+// the registered callback like a change through the camera web interface
+gboolean stub_axparameter_load_manifest(const gchar *path);
+void stub_axparameter_set(const gchar *name, const gchar *value);
+
+// Events are delivered synchronously on the calling thread, the benchmark
+// fires them from main loop sources like the SDK dispatches its callbacks
+gboolean stub_axevent_subscribed(const gchar *source);
+guint stub_axevent_fire(const gchar *source, const gchar *label, gboolean active, gint64 timestamp_us);
+
+// Allocation calls made by the current thread are not counted while paused
+void alloc_count_pause(bool paused);
+void alloc_count_reset(void);
+uint64_t alloc_count_get(void);
+
+#endif /* _BENCH_STUBS_H_ */
@@ -0,0 +1,13 @@
+#!/bin/sh
+# Compares handing every axevent over on its own with handing the events of a
+# main loop dispatch over in one batch, at increasing event rates. Arguments
+# are passed on to the benchmark, e.g. --profiles 16 --duration 5.
+BENCH=${BENCH:-./bench/opcuavmdev-bench}
+
+for rate in 1000 10000 100000; do
+    for batching in Off On; do
+        echo "== $rate events/s, eventbatching $batching"
+        "$BENCH" --rate "$rate" --param "eventbatching=$batching" "$@" |
+            grep -E '^(events|notifications|latency|  queue|allocations)'
+    done
+done
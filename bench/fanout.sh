@@ -0,0 +1,13 @@
+#!/bin/sh
+# Fans the alarms out to many clients, each monitoring every profile, and
+# compares the bridge's CPU per notification and its memory across the
+# server engine profiles. Arguments are passed on to the benchmark, e.g.
+# --profiles 64 --duration 5.
+BENCH=${BENCH:-./bench/opcuavmdev-bench}
+CLIENTS=${CLIENTS:-64}
+
+for profile in Default ManyClients; do
+    echo "== $CLIENTS clients, engineprofile $profile"
+    "$BENCH" --rate 1000 --clients "$CLIENTS" --param "engineprofile=$profile" "$@" |
+        grep -E '^(Monitoring|events|notifications|latency|cpu|rss)'
+done
@@ -0,0 +1,13 @@
+#!/bin/sh
+# Compares the server engine profiles at increasing event rates. The client
+# asks for the fastest intervals, so it gets what each profile allows.
+# Arguments are passed on to the benchmark, e.g. --profiles 16 --duration 5.
+BENCH=${BENCH:-./bench/opcuavmdev-bench}
+
+for rate in 100 1000 10000; do
+    for profile in Default LowLatency ManyClients; do
+        echo "== $rate events/s, engineprofile $profile"
+        "$BENCH" --rate "$rate" --param "engineprofile=$profile" "$@" |
+            grep -E '^(Monitoring|events|notifications|latency|cpu)'
+    done
+done
@@ -0,0 +1,570 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <axevent.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "bench_stubs.h"
+
+/*
+ * Minimal in-process replacement for the axevent library: subscriptions are
+ * kept in a table and an event is delivered to every subscription whose key
+ * value set matches it. A key without a value in the subscription matches
+ * any value, like in the SDK.
+ */
+
+#define STUB_KEYS_MAX 8
+#define STUB_SUBSCRIPTIONS_MAX 64
+
+typedef struct
+{
+    gchar *key;
+    gchar *name_space;
+    AXEventValueType type;
+    gboolean has_value;
+    gint integer;
+    gdouble number;
+    gchar *string;
+    gchar *value_nice_name;
+} stub_key_value_t;
+
+struct _AXEventKeyValueSet
+{
+    guint count;
+    stub_key_value_t entries[STUB_KEYS_MAX];
+};
+
+struct _AXEvent
+{
+    AXEventKeyValueSet *key_value_set;
+    GDateTime *time_stamp;
+};
+
+typedef struct
+{
+    guint id;
+    AXEventKeyValueSet *key_value_set;
+    AXSubscriptionCallback callback;
+    gpointer user_data;
+} stub_subscription_t;
+
+struct _AXEventHandler
+{
+    GMutex lock;
+    guint next_id;
+    stub_subscription_t subscriptions[STUB_SUBSCRIPTIONS_MAX];
+};
+
+// The bridge only ever creates one handler
+static AXEventHandler *handler;
+
+static stub_key_value_t *stub_find(const AXEventKeyValueSet *key_value_set, const gchar *key, const gchar *name_space)
+{
+    for (guint i = 0; i < key_value_set->count; i++)
+    {
+        stub_key_value_t *entry = (stub_key_value_t *)&key_value_set->entries[i];
+
+        if (0 == g_strcmp0(entry->key, key) && 0 == g_strcmp0(entry->name_space, name_space))
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static gboolean stub_matches(const AXEventKeyValueSet *subscription, const AXEventKeyValueSet *event)
+{
+    for (guint i = 0; i < subscription->count; i++)
+    {
+        const stub_key_value_t *wanted = &subscription->entries[i];
+        const stub_key_value_t *entry = stub_find(event, wanted->key, wanted->name_space);
+
+        if (NULL == entry)
+        {
+            return FALSE;
+        }
+        if (!wanted->has_value)
+        {
+            continue;
+        }
+        if (wanted->integer != entry->integer || wanted->number != entry->number ||
+            0 != g_strcmp0(wanted->string, entry->string))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static AXEventKeyValueSet *stub_copy(const AXEventKeyValueSet *key_value_set)
+{
+    AXEventKeyValueSet *copy = g_new0(AXEventKeyValueSet, 1);
+
+    for (guint i = 0; i < key_value_set->count; i++)
+    {
+        const stub_key_value_t *entry = &key_value_set->entries[i];
+
+        copy->entries[i] = *entry;
+        copy->entries[i].key = g_strdup(entry->key);
+        copy->entries[i].name_space = g_strdup(entry->name_space);
+        copy->entries[i].string = g_strdup(entry->string);
+        copy->entries[i].value_nice_name = g_strdup(entry->value_nice_name);
+    }
+    copy->count = key_value_set->count;
+
+    return copy;
+}
+
+AXEventHandler *ax_event_handler_new(void)
+{
+    g_assert(NULL == handler);
+
+    handler = g_new0(AXEventHandler, 1);
+    g_mutex_init(&handler->lock);
+    handler->next_id = 1;
+
+    return handler;
+}
+
+void ax_event_handler_free(AXEventHandler *event_handler)
+{
+    g_assert(handler == event_handler);
+
+    for (guint i = 0; i < STUB_SUBSCRIPTIONS_MAX; i++)
+    {
+        if (0 != event_handler->subscriptions[i].id)
+        {
+            ax_event_key_value_set_free(event_handler->subscriptions[i].key_value_set);
+        }
+    }
+    g_mutex_clear(&event_handler->lock);
+    g_free(event_handler);
+    handler = NULL;
+}
+
+gboolean ax_event_handler_subscribe(
+    AXEventHandler *event_handler,
+    AXEventKeyValueSet *key_value_set,
+    guint *subscription,
+    AXSubscriptionCallback callback,
+    gpointer user_data,
+    GError **error)
+{
+    gboolean result = FALSE;
+
+    (void)error;
+
+    g_mutex_lock(&event_handler->lock);
+    for (guint i = 0; i < STUB_SUBSCRIPTIONS_MAX; i++)
+    {
+        stub_subscription_t *entry = &event_handler->subscriptions[i];
+
+        if (0 == entry->id)
+        {
+            entry->id = event_handler->next_id++;
+            entry->key_value_set = stub_copy(key_value_set);
+            entry->callback = callback;
+            entry->user_data = user_data;
+            *subscription = entry->id;
+            result = TRUE;
+            break;
+        }
+    }
+    g_mutex_unlock(&event_handler->lock);
+
+    return result;
+}
+
+gboolean ax_event_handler_unsubscribe(AXEventHandler *event_handler, guint subscription, GError **error)
+{
+    gboolean result = FALSE;
+
+    (void)error;
+
+    g_mutex_lock(&event_handler->lock);
+    for (guint i = 0; i < STUB_SUBSCRIPTIONS_MAX; i++)
+    {
+        stub_subscription_t *entry = &event_handler->subscriptions[i];
+
+        if (subscription == entry->id)
+        {
+            ax_event_key_value_set_free(entry->key_value_set);
+            memset(entry, 0, sizeof(*entry));
+            result = TRUE;
+            break;
+        }
+    }
+    g_mutex_unlock(&event_handler->lock);
+
+    return result;
+}
+
+AXEventKeyValueSet *ax_event_key_value_set_new(void)
+{
+    return g_new0(AXEventKeyValueSet, 1);
+}
+
+void ax_event_key_value_set_free(AXEventKeyValueSet *key_value_set)
+{
+    if (NULL == key_value_set)
+    {
+        return;
+    }
+
+    for (guint i = 0; i < key_value_set->count; i++)
+    {
+        g_free(key_value_set->entries[i].key);
+        g_free(key_value_set->entries[i].name_space);
+        g_free(key_value_set->entries[i].string);
+        g_free(key_value_set->entries[i].value_nice_name);
+    }
+    g_free(key_value_set);
+}
+
+gboolean ax_event_key_value_set_add_key_value(
+    AXEventKeyValueSet *key_value_set,
+    const gchar *key,
+    const gchar *name_space,
+    gconstpointer value,
+    AXEventValueType value_type,
+    GError **error)
+{
+    stub_key_value_t *entry = stub_find(key_value_set, key, name_space);
+
+    (void)error;
+
+    if (NULL == entry)
+    {
+        if (STUB_KEYS_MAX == key_value_set->count)
+        {
+            return FALSE;
+        }
+        entry = &key_value_set->entries[key_value_set->count++];
+        entry->key = g_strdup(key);
+        entry->name_space = g_strdup(name_space);
+    }
+
+    g_free(entry->string);
+    entry->string = NULL;
+    entry->integer = 0;
+    entry->number = 0;
+    entry->type = value_type;
+    entry->has_value = NULL != value;
+    if (NULL == value)
+    {
+        return TRUE;
+    }
+
+    switch (value_type)
+    {
+    case AX_VALUE_TYPE_INT:
+    case AX_VALUE_TYPE_BOOL:
+        entry->integer = *(const gint *)value;
+        break;
+    case AX_VALUE_TYPE_DOUBLE:
+        entry->number = *(const gdouble *)value;
+        break;
+    default:
+        entry->string = g_strdup(value);
+        break;
+    }
+
+    return TRUE;
+}
+
+gboolean ax_event_key_value_set_add_key_values(AXEventKeyValueSet *key_value_set, GError **error, ...)
+{
+    gboolean result = TRUE;
+    const gchar *key;
+    va_list args;
+
+    va_start(args, error);
+    while (NULL != (key = va_arg(args, const gchar *)))
+    {
+        const gchar *name_space = va_arg(args, const gchar *);
+        gconstpointer value = va_arg(args, gconstpointer);
+        AXEventValueType value_type = va_arg(args, AXEventValueType);
+
+        result = ax_event_key_value_set_add_key_value(key_value_set, key, name_space, value, value_type, error) &&
+                 result;
+    }
+    va_end(args);
+
+    return result;
+}
+
+gboolean ax_event_key_value_set_add_nice_names(
+    AXEventKeyValueSet *key_value_set,
+    const gchar *key,
+    const gchar *name_space,
+    const gchar *key_nice_name,
+    const gchar *value_nice_name,
+    GError **error)
+{
+    stub_key_value_t *entry = stub_find(key_value_set, key, name_space);
+
+    (void)key_nice_name;
+    (void)error;
+
+    if (NULL == entry)
+    {
+        return FALSE;
+    }
+    g_free(entry->value_nice_name);
+    entry->value_nice_name = g_strdup(value_nice_name);
+    return TRUE;
+}
+
+static const stub_key_value_t *stub_get(
+    const AXEventKeyValueSet *key_value_set,
+    const gchar *key,
+    const gchar *name_space,
+    AXEventValueType value_type)
+{
+    const stub_key_value_t *entry = stub_find(key_value_set, key, name_space);
+
+    if (NULL == entry || !entry->has_value || value_type != entry->type)
+    {
+        return NULL;
+    }
+    return entry;
+}
+
+gboolean ax_event_key_value_set_get_boolean(
+    const AXEventKeyValueSet *key_value_set,
+    const gchar *key,
+    const gchar *name_space,
+    gboolean *value,
+    GError **error)
+{
+    const stub_key_value_t *entry = stub_get(key_value_set, key, name_space, AX_VALUE_TYPE_BOOL);
+
+    (void)error;
+
+    if (NULL == entry)
+    {
+        return FALSE;
+    }
+    *value = entry->integer;
+    return TRUE;
+}
+
+gboolean ax_event_key_value_set_get_integer(
+    const AXEventKeyValueSet *key_value_set,
+    const gchar *key,
+    const gchar *name_space,
+    gint *value,
+    GError **error)
+{
+    const stub_key_value_t *entry = stub_get(key_value_set, key, name_space, AX_VALUE_TYPE_INT);
+
+    (void)error;
+
+    if (NULL == entry)
+    {
+        return FALSE;
+    }
+    *value = entry->integer;
+    return TRUE;
+}
+
+gboolean ax_event_key_value_set_get_double(
+    const AXEventKeyValueSet *key_value_set,
+    const gchar *key,
+    const gchar *name_space,
+    gdouble *value,
+    GError **error)
+{
+    const stub_key_value_t *entry = stub_get(key_value_set, key, name_space, AX_VALUE_TYPE_DOUBLE);
+
+    (void)error;
+
+    if (NULL == entry)
+    {
+        return FALSE;
+    }
+    *value = entry->number;
+    return TRUE;
+}
+
+gboolean ax_event_key_value_set_get_string(
+    const AXEventKeyValueSet *key_value_set,
+    const gchar *key,
+    const gchar *name_space,
+    gchar **value,
+    GError **error)
+{
+    const stub_key_value_t *entry = stub_get(key_value_set, key, name_space, AX_VALUE_TYPE_STRING);
+
+    (void)error;
+
+    if (NULL == entry)
+    {
+        return FALSE;
+    }
+
+    // The SDK hands out a copy, so does the stub to keep allocation counts honest
+    *value = g_strdup(entry->string);
+    return TRUE;
+}
+
+gboolean ax_event_key_value_set_get_value_nice_name(
+    const AXEventKeyValueSet *key_value_set,
+    const gchar *key,
+    const gchar *name_space,
+    gchar **value,
+    GError **error)
+{
+    const stub_key_value_t *entry = stub_find(key_value_set, key, name_space);
+
+    (void)error;
+
+    if (NULL == entry || NULL == entry->value_nice_name)
+    {
+        return FALSE;
+    }
+    *value = g_strdup(entry->value_nice_name);
+    return TRUE;
+}
+
+AXEvent *ax_event_new2(AXEventKeyValueSet *key_value_set, GDateTime *time_stamp)
+{
+    AXEvent *event = g_new0(AXEvent, 1);
+
+    event->key_value_set = stub_copy(key_value_set);
+    event->time_stamp = (NULL != time_stamp) ? g_date_time_ref(time_stamp) : NULL;
+
+    return event;
+}
+
+void ax_event_free(AXEvent *event)
+{
+    if (NULL == event)
+    {
+        return;
+    }
+
+    ax_event_key_value_set_free(event->key_value_set);
+    if (NULL != event->time_stamp)
+    {
+        g_date_time_unref(event->time_stamp);
+    }
+    g_free(event);
+}
+
+const AXEventKeyValueSet *ax_event_get_key_value_set(AXEvent *event)
+{
+    return event->key_value_set;
+}
+
+GDateTime *ax_event_get_time_stamp2(AXEvent *event)
+{
+    return event->time_stamp;
+}
+
+gboolean stub_axevent_subscribed(const gchar *source)
+{
+    gboolean found = FALSE;
+
+    if (NULL == handler)
+    {
+        return FALSE;
+    }
+
+    g_mutex_lock(&handler->lock);
+    for (guint i = 0; i < STUB_SUBSCRIPTIONS_MAX && !found; i++)
+    {
+        const stub_subscription_t *entry = &handler->subscriptions[i];
+
+        if (0 != entry->id)
+        {
+            const stub_key_value_t *topic1 = stub_find(entry->key_value_set, "topic1", "tnsaxis");
+            found = NULL != topic1 && 0 == g_strcmp0(topic1->string, source);
+        }
+    }
+    g_mutex_unlock(&handler->lock);
+
+    return found;
+}
+
+guint stub_axevent_fire(const gchar *source, const gchar *label, gboolean active, gint64 timestamp_us)
+{
+    stub_subscription_t matched[STUB_SUBSCRIPTIONS_MAX];
+    AXEventKeyValueSet *key_value_set;
+    GDateTime *epoch;
+    GDateTime *time_stamp;
+    gchar *nice_name;
+    guint count = 0;
+
+    g_assert(NULL != handler);
+
+    // Building the event is the SDK's work, not the bridge's
+    alloc_count_pause(true);
+    key_value_set = ax_event_key_value_set_new();
+    (void)ax_event_key_value_set_add_key_values(
+        key_value_set,
+        NULL,
+        "topic0",
+        "tnsaxis",
+        "CameraApplicationPlatform",
+        AX_VALUE_TYPE_STRING,
+        "topic1",
+        "tnsaxis",
+        source,
+        AX_VALUE_TYPE_STRING,
+        "topic2",
+        "tnsaxis",
+        label,
+        AX_VALUE_TYPE_STRING,
+        "active",
+        NULL,
+        &active,
+        AX_VALUE_TYPE_BOOL,
+        NULL);
+    // Like the analytics, give the profile a human readable name
+    nice_name = g_strdup_printf("%s: Profile %s", source, label);
+    (void)ax_event_key_value_set_add_nice_names(key_value_set, "topic2", "tnsaxis", label, nice_name, NULL);
+    g_free(nice_name);
+    epoch = g_date_time_new_from_unix_utc(timestamp_us / G_USEC_PER_SEC);
+    time_stamp = g_date_time_add(epoch, timestamp_us % G_USEC_PER_SEC);
+    g_date_time_unref(epoch);
+
+    g_mutex_lock(&handler->lock);
+    for (guint i = 0; i < STUB_SUBSCRIPTIONS_MAX; i++)
+    {
+        if (0 != handler->subscriptions[i].id && stub_matches(handler->subscriptions[i].key_value_set, key_value_set))
+        {
+            matched[count++] = handler->subscriptions[i];
+        }
+    }
+    g_mutex_unlock(&handler->lock);
+
+    for (guint i = 0; i < count; i++)
+    {
+        AXEvent *event = ax_event_new2(key_value_set, time_stamp);
+
+        alloc_count_pause(false);
+        matched[i].callback(matched[i].id, event, matched[i].user_data);
+        alloc_count_pause(true);
+    }
+
+    g_date_time_unref(time_stamp);
+    ax_event_key_value_set_free(key_value_set);
+    alloc_count_pause(false);
+
+    return count;
+}
@@ -0,0 +1,214 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <axparameter.h>
+#include <string.h>
+
+#include "bench_stubs.h"
+
+/*
+ * Minimal in-process replacement for the axparameter library. Values start
+ * from the defaults in the paramConfig section of manifest.json so the
+ * benchmark always runs with the same configuration as a fresh install.
+ */
+
+#define STUB_PARAMS_MAX 64
+
+typedef struct
+{
+    gchar *name;
+    gchar *value;
+    AXParameterCallback callback;
+    gpointer user_data;
+} stub_param_t;
+
+struct _AXParameter
+{
+    int unused;
+};
+
+static AXParameter parameter;
+static GMutex lock;
+static stub_param_t params[STUB_PARAMS_MAX];
+static guint param_count;
+
+static stub_param_t *stub_param(const gchar *name, gboolean create)
+{
+    for (guint i = 0; i < param_count; i++)
+    {
+        if (0 == g_strcmp0(params[i].name, name))
+        {
+            return &params[i];
+        }
+    }
+
+    if (!create || STUB_PARAMS_MAX == param_count)
+    {
+        return NULL;
+    }
+    params[param_count].name = g_strdup(name);
+    return &params[param_count++];
+}
+
+// Returns a copy of the string value following "key": after from, or NULL
+static gchar *stub_json_string(const gchar *from, const gchar *key, const gchar **end)
+{
+    gchar *quoted = g_strdup_printf("\"%s\"", key);
+    const gchar *start = strstr(from, quoted);
+    const gchar *stop;
+
+    g_free(quoted);
+    if (NULL == start || NULL == (start = strchr(start + strlen(key) + 2, '"')))
+    {
+        return NULL;
+    }
+    start++;
+    if (NULL == (stop = strchr(start, '"')))
+    {
+        return NULL;
+    }
+
+    *end = stop + 1;
+    return g_strndup(start, stop - start);
+}
+
+gboolean stub_axparameter_load_manifest(const gchar *path)
+{
+    gchar *contents = NULL;
+    const gchar *pos;
+    gchar *name;
+
+    if (!g_file_get_contents(path, &contents, NULL, NULL) || NULL == (pos = strstr(contents, "\"paramConfig\"")))
+    {
+        g_free(contents);
+        return FALSE;
+    }
+
+    g_mutex_lock(&lock);
+    while (NULL != (name = stub_json_string(pos, "name", &pos)))
+    {
+        gchar *value = stub_json_string(pos, "default", &pos);
+        stub_param_t *param = stub_param(name, TRUE);
+
+        // Values set before loading the manifest win over its defaults
+        if (NULL != param && NULL == param->value)
+        {
+            param->value = value;
+            value = NULL;
+        }
+        g_free(value);
+        g_free(name);
+    }
+    g_mutex_unlock(&lock);
+
+    g_free(contents);
+    return TRUE;
+}
+
+void stub_axparameter_set(const gchar *name, const gchar *value)
+{
+    AXParameterCallback callback = NULL;
+    gpointer user_data = NULL;
+    stub_param_t *param;
+
+    g_mutex_lock(&lock);
+    param = stub_param(name, TRUE);
+    if (NULL != param)
+    {
+        g_free(param->value);
+        param->value = g_strdup(value);
+        callback = param->callback;
+        user_data = param->user_data;
+    }
+    g_mutex_unlock(&lock);
+
+    if (NULL != callback)
+    {
+        callback(name, value, user_data);
+    }
+}
+
+AXParameter *ax_parameter_new(const gchar *app_name, GError **error)
+{
+    (void)app_name;
+    (void)error;
+
+    return &parameter;
+}
+
+void ax_parameter_free(AXParameter *axparameter)
+{
+    g_assert(&parameter == axparameter);
+
+    // Parameters outlive the bridge, only forget the callbacks
+    g_mutex_lock(&lock);
+    for (guint i = 0; i < param_count; i++)
+    {
+        params[i].callback = NULL;
+        params[i].user_data = NULL;
+    }
+    g_mutex_unlock(&lock);
+}
+
+gboolean ax_parameter_register_callback(
+    AXParameter *axparameter,
+    const gchar *name,
+    AXParameterCallback callback,
+    gpointer user_data,
+    GError **error)
+{
+    stub_param_t *param;
+
+    g_assert(&parameter == axparameter);
+
+    g_mutex_lock(&lock);
+    param = stub_param(name, FALSE);
+    if (NULL != param)
+    {
+        param->callback = callback;
+        param->user_data = user_data;
+    }
+    g_mutex_unlock(&lock);
+
+    if (NULL == param)
+    {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT, "No parameter '%s'", name);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+gboolean ax_parameter_get(AXParameter *axparameter, const gchar *name, gchar **value, GError **error)
+{
+    stub_param_t *param;
+
+    g_assert(&parameter == axparameter);
+
+    g_mutex_lock(&lock);
+    param = stub_param(name, FALSE);
+    if (NULL != param)
+    {
+        *value = g_strdup(param->value);
+    }
+    g_mutex_unlock(&lock);
+
+    if (NULL == param)
+    {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT, "No parameter '%s'", name);
+        return FALSE;
+    }
+    return TRUE;
+}
@@ -0,0 +1,221 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "opcua_activity.h"
+#include "opcua_profiles.h"
+
+#define ACTIVITY_NAME_SIZE 192
+#define ACTIVITY_ID_FORMAT "%s/State"
+
+typedef struct
+{
+    char *name;
+    char *description;
+    int type;
+} activity_field_info_t;
+
+static const activity_field_info_t fields[ACTIVITY_FIELDS] = {
+    {"Active", "Published state of the profile", UA_TYPES_BOOLEAN},
+    {"LastRisingTime", "Source time of the last activation", UA_TYPES_DATETIME},
+    {"LastFallingTime", "Source time of the last deactivation", UA_TYPES_DATETIME},
+    {"ActivationCount", "Number of activations", UA_TYPES_UINT32},
+    {"ActiveDuration", "Milliseconds spent active in total", UA_TYPES_DOUBLE},
+    {"EpisodeDuration", "Milliseconds spent active since the last activation, 0 when inactive", UA_TYPES_DOUBLE},
+};
+
+static UA_Double activity_ms(UA_DateTime duration)
+{
+    // Source and server clocks may disagree slightly
+    return (0 < duration) ? (UA_Double)duration / UA_DATETIME_MSEC : 0.0;
+}
+
+static UA_StatusCode activity_read(
+    UA_Server *server,
+    const UA_NodeId *session_id,
+    void *session_context,
+    const UA_NodeId *node_id,
+    void *node_context,
+    UA_Boolean source_timestamp,
+    const UA_NumericRange *range,
+    UA_DataValue *value)
+{
+    const activity_node_t *node = node_context;
+    const activity_t *activity = node->activity;
+    UA_DateTime episode = 0;
+    UA_Double duration;
+
+    (void)server;
+    (void)session_id;
+    (void)session_context;
+    (void)node_id;
+    (void)source_timestamp;
+    (void)range;
+
+    if (activity->active && 0 != activity->last_rising)
+    {
+        episode = UA_DateTime_now() - activity->last_rising;
+    }
+
+    value->hasValue = true;
+    switch (node->field)
+    {
+    case ACTIVITY_FIELD_ACTIVE:
+        // Stamped with the time the current state began
+        value->sourceTimestamp = activity->active ? activity->last_rising : activity->last_falling;
+        value->hasSourceTimestamp = (0 != value->sourceTimestamp);
+        return UA_Variant_setScalarCopy(&value->value, &activity->active, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    case ACTIVITY_FIELD_LAST_RISING:
+        return UA_Variant_setScalarCopy(&value->value, &activity->last_rising, &UA_TYPES[UA_TYPES_DATETIME]);
+    case ACTIVITY_FIELD_LAST_FALLING:
+        return UA_Variant_setScalarCopy(&value->value, &activity->last_falling, &UA_TYPES[UA_TYPES_DATETIME]);
+    case ACTIVITY_FIELD_ACTIVATIONS:
+        return UA_Variant_setScalarCopy(&value->value, &activity->activations, &UA_TYPES[UA_TYPES_UINT32]);
+    case ACTIVITY_FIELD_ACTIVE_DURATION:
+        duration = activity_ms(activity->finished) + activity_ms(episode);
+        break;
+    default:
+        duration = activity_ms(episode);
+        break;
+    }
+    return UA_Variant_setScalarCopy(&value->value, &duration, &UA_TYPES[UA_TYPES_DOUBLE]);
+}
+
+UA_StatusCode activity_add_nodes(UA_Server *server, activity_t *activity, int id)
+{
+    assert(NULL != server);
+    assert(NULL != activity);
+
+    UA_ObjectAttributes object_attr = UA_ObjectAttributes_default;
+    UA_DataSource source = {activity_read, NULL};
+    char object_name[ACTIVITY_NAME_SIZE];
+    char object_id[ACTIVITY_NAME_SIZE];
+    UA_StatusCode status;
+
+    // Shown with a "State" suffix, like its "Alarm" condition. The NodeId
+    // hangs off the profile's after a "/", which labels never contain, so
+    // it cannot clash with another profile.
+    if (sizeof(object_name) <= (size_t)snprintf(object_name, sizeof(object_name), "%sState", profiles_label(id)) ||
+        sizeof(object_id) <= (size_t)snprintf(object_id, sizeof(object_id), ACTIVITY_ID_FORMAT, profiles_node_name(id)))
+    {
+        return UA_STATUSCODE_BADNODEIDINVALID;
+    }
+
+    object_attr.displayName = UA_LOCALIZEDTEXT("en-US", object_name);
+    object_attr.description = UA_LOCALIZEDTEXT("en-US", "Activation statistics of the profile");
+    status = UA_Server_addObjectNode(
+        server,
+        UA_NODEID_STRING(1, object_id),
+        UA_NODEID_STRING(1, (char *)profiles_source_name(profiles_source(id))),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+        UA_QUALIFIEDNAME(1, object_name),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+        object_attr,
+        NULL,
+        NULL);
+
+    for (int field = 0; field < ACTIVITY_FIELDS && UA_STATUSCODE_GOOD == status; field++)
+    {
+        UA_VariableAttributes attr = UA_VariableAttributes_default;
+        activity_node_t *node = &activity->nodes[field];
+        char name[ACTIVITY_NAME_SIZE];
+
+        node->activity = activity;
+        node->field = field;
+
+        attr.displayName = UA_LOCALIZEDTEXT("en-US", fields[field].name);
+        attr.description = UA_LOCALIZEDTEXT("en-US", fields[field].description);
+        attr.dataType = UA_TYPES[fields[field].type].typeId;
+        attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+
+        // Durations are OPC UA Durations, i.e. milliseconds as a Double
+        if (UA_TYPES_DOUBLE == fields[field].type)
+        {
+            attr.dataType = UA_NODEID_NUMERIC(0, UA_NS0ID_DURATION);
+        }
+
+        // The string NodeId is copied by the server
+        if (sizeof(name) <= (size_t)snprintf(name, sizeof(name), "%s/%s", object_id, fields[field].name))
+        {
+            return UA_STATUSCODE_BADNODEIDINVALID;
+        }
+        status = UA_Server_addDataSourceVariableNode(
+            server,
+            UA_NODEID_STRING(1, name),
+            UA_NODEID_STRING(1, object_id),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+            UA_QUALIFIEDNAME(1, fields[field].name),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+            attr,
+            source,
+            node,
+            NULL);
+    }
+
+    return status;
+}
+
+void activity_remove_nodes(UA_Server *server, int id)
+{
+    assert(NULL != server);
+
+    char object_id[ACTIVITY_NAME_SIZE];
+
+    // The child variables are removed with the object
+    if (sizeof(object_id) > (size_t)snprintf(object_id, sizeof(object_id), ACTIVITY_ID_FORMAT, profiles_node_name(id)))
+    {
+        (void)UA_Server_deleteNode(server, UA_NODEID_STRING(1, object_id), true);
+    }
+}
+
+void activity_reset(activity_t *activity, UA_Boolean active, UA_DateTime timestamp)
+{
+    assert(NULL != activity);
+
+    // A profile first seen active is an activation
+    activity->active = active;
+    activity->last_rising = active ? timestamp : 0;
+    activity->last_falling = 0;
+    activity->activations = active ? 1 : 0;
+    activity->finished = 0;
+}
+
+void activity_update(activity_t *activity, UA_Boolean active, UA_DateTime timestamp)
+{
+    assert(NULL != activity);
+
+    if (active == activity->active)
+    {
+        return;
+    }
+
+    activity->active = active;
+    if (active)
+    {
+        activity->last_rising = timestamp;
+        activity->activations++;
+    }
+    else
+    {
+        if (0 != activity->last_rising && timestamp > activity->last_rising)
+        {
+            activity->finished += timestamp - activity->last_rising;
+        }
+        activity->last_falling = timestamp;
+    }
+}
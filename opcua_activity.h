@@ -0,0 +1,67 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_ACTIVITY_H_
+#define _OPCUA_ACTIVITY_H_
+
+#include <open62541/server.h>
+
+/*
+ * Activation statistics of a profile, exposed as a "<label>State" object
+ * next to the profile variable, with the NodeId "<source>.<label>/State".
+ * They are kept up to date in O(1) per published transition, the durations
+ * of the running episode are derived from the clock when a client reads
+ * them. All of them count from the moment the bridge first saw the profile.
+ *
+ * Belongs to the OPC UA server thread.
+ */
+
+typedef enum
+{
+    ACTIVITY_FIELD_ACTIVE,
+    ACTIVITY_FIELD_LAST_RISING,
+    ACTIVITY_FIELD_LAST_FALLING,
+    ACTIVITY_FIELD_ACTIVATIONS,
+    ACTIVITY_FIELD_ACTIVE_DURATION,
+    ACTIVITY_FIELD_EPISODE_DURATION,
+    ACTIVITY_FIELDS
+} activity_field_t;
+
+struct activity;
+
+// Node context of every child variable
+typedef struct
+{
+    const struct activity *activity;
+    activity_field_t field;
+} activity_node_t;
+
+typedef struct activity
+{
+    UA_Boolean active;
+    UA_DateTime last_rising; // 0 when never active
+    UA_DateTime last_falling; // 0 when never deactivated
+    UA_UInt32 activations;
+    UA_DateTime finished; // active time of the finished episodes
+    activity_node_t nodes[ACTIVITY_FIELDS];
+} activity_t;
+
+UA_StatusCode activity_add_nodes(UA_Server *server, activity_t *activity, int id);
+void activity_remove_nodes(UA_Server *server, int id);
+void activity_reset(activity_t *activity, UA_Boolean active, UA_DateTime timestamp);
+void activity_update(activity_t *activity, UA_Boolean active, UA_DateTime timestamp);
+
+#endif /* _OPCUA_ACTIVITY_H_ */
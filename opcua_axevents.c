@@ -19,7 +19,14 @@
 
 #include "opcua_axevents.h"
 #include "opcua_common.h"
+#include "opcua_diagnostics.h"
+#include "opcua_evqueue.h"
+#include "opcua_export.h"
+#include "opcua_latency.h"
+#include "opcua_metadata.h"
 #include "opcua_open62541.h"
+#include "opcua_profiles.h"
+#include "opcua_trace.h"
 
 /*
  * - Example AXEVENT for VMD 4 Alarm - Any Profile
@@ -47,24 +54,89 @@
  * <MESSAGE > [active = '1'] {onvif-data} {property-state}
  *
  */
-#define AXEV_CTX_DISCOVERY "axevents-discovery"
 #define AXEV_TNSAXIS_TOPIC0 "CameraApplicationPlatform"
 #define AXEV_ACTIVE "active"
+#define AXEV_SOURCE_SEPARATOR ","
+// Events staged for one hand-over, a longer burst is handed over in parts
+#define AXEV_BATCH_MAX 64
 
-static guint subid = 0;
+/*
+ * One subscription per topic1 event source, indexed by the source id from
+ * the profile index. The entry is also the subscription's user data and
+ * carries the metadata keys resolved for the source when subscribing.
+ */
+typedef struct
+{
+    guint subid;
+    gint source;
+    gboolean wanted;
+    metadata_keys_t metadata;
+} axevent_subscription_t;
+
+static axevent_subscription_t subscriptions[PROFILES_SOURCES_MAX];
+
+// Events dispatched by the main loop in one go are staged here and handed to
+// the OPC UA server thread together once the main loop is idle
+static evqueue_record_t batch[AXEV_BATCH_MAX];
+static size_t batch_count;
+static guint batch_source;
+static gboolean batching = TRUE;
+
+static void axevent_flush(void)
+{
+    (void)evqueue_push_batch(batch, batch_count);
+    ua_server_wakeup();
+    export_records(batch, batch_count);
+    batch_count = 0;
+}
+
+static gboolean axevent_flush_idle(gpointer data)
+{
+    (void)data;
+
+    batch_source = 0;
+    axevent_flush();
+    return G_SOURCE_REMOVE;
+}
+
+static void axevent_queue(const evqueue_record_t *record)
+{
+    if (!batching)
+    {
+        (void)evqueue_push(record);
+        ua_server_wakeup();
+        export_records(record, 1);
+        return;
+    }
+
+    batch[batch_count++] = *record;
+    if (AXEV_BATCH_MAX == batch_count)
+    {
+        axevent_flush();
+    }
+    else if (0 == batch_source)
+    {
+        batch_source = g_idle_add(axevent_flush_idle, NULL);
+    }
+}
 
 static void axevent_sub_callback(guint id, AXEvent *event, void *data)
 {
+    const axevent_subscription_t *subscription = data;
     const AXEventKeyValueSet *key_value_set;
+    const GDateTime *timestamp;
+    evqueue_record_t record;
     gboolean active;
     gchar *label;
-    gint value;
+    int profile;
 
     (void)id;
 
-    // Check for the discovery payload
-    value = strcmp(AXEV_CTX_DISCOVERY, (char *)data);
-    if (0 != value)
+    record.received = latency_now_ns();
+    diagnostics_count(DIAGNOSTICS_EVENTS_RECEIVED);
+
+    // Check for the subscription payload
+    if (NULL == subscription)
     {
         goto free;
     }
@@ -78,14 +150,42 @@ static void axevent_sub_callback(guint id, AXEvent *event, void *data)
         goto free;
     }
 
+    // The SDK hands out a copy of the label, intern it and release the copy
+    // right away so that only the profile id travels further
     if (!ax_event_key_value_set_get_string(key_value_set, "topic2", "tnsaxis", &label, NULL))
     {
         LOG_E("%s/%s: Failed to get label value from axevent", __FILE__, __FUNCTION__);
         goto free;
     }
 
-    // Inform the OPC UA server of the received axevent
-    ua_server_axevent_process(label, active);
+    profile = profiles_insert(subscription->source, label);
+    if (0 > profile)
+    {
+        LOG_E("%s/%s: Profile index full or label invalid, ignoring '%s' axevent", __FILE__, __FUNCTION__, label);
+        g_free(label);
+        goto free;
+    }
+    g_free(label);
+
+    // Keep the time the event was raised, clients get it as source timestamp
+    timestamp = ax_event_get_time_stamp2(event);
+    if (NULL != timestamp)
+    {
+        record.timestamp = g_date_time_to_unix((GDateTime *)timestamp) * G_USEC_PER_SEC +
+                           g_date_time_get_microsecond((GDateTime *)timestamp);
+    }
+    else
+    {
+        record.timestamp = g_get_real_time();
+    }
+
+    // Hand the received axevent over to the OPC UA server thread, never block
+    // the event dispatcher on node store work
+    record.profile = (uint16_t)profile;
+    record.active = active;
+    metadata_decode(&subscription->metadata, profile, key_value_set, &record.metadata);
+    trace_append(&record, subscription->source);
+    axevent_queue(&record);
 
 free:
     // Free the received event, n.b. AXEventKeyValueSet should not be freed
@@ -93,14 +193,16 @@ free:
     ax_event_free(event);
 }
 
-static guint axevent_subscribe(AXEventHandler *ehandler, const gchar *evtsource)
+static guint axevent_subscribe(AXEventHandler *ehandler, axevent_subscription_t *subscription)
 {
     assert(NULL != ehandler);
-    assert(NULL != evtsource);
+    assert(NULL != subscription);
 
+    const gchar *evtsource = profiles_source_name(subscription->source);
     AXEventKeyValueSet *key_value_set;
     guint id = 0;
 
+    metadata_resolve(evtsource, &subscription->metadata);
     key_value_set = ax_event_key_value_set_new();
 
     // Setup axevent subscription data
@@ -135,7 +237,7 @@ static guint axevent_subscribe(AXEventHandler *ehandler, const gchar *evtsource)
             key_value_set,                                // key value set
             &id,                                          // subscription id
             (AXSubscriptionCallback)axevent_sub_callback, // callback function
-            AXEV_CTX_DISCOVERY,                           // user data
+            subscription,                                 // user data
             NULL))                                        // GError
     {
         LOG_I(
@@ -158,24 +260,176 @@ static guint axevent_subscribe(AXEventHandler *ehandler, const gchar *evtsource)
     return id;
 }
 
-gboolean axevent_setup(AXEventHandler *ehandler, const gchar *topic)
+static void axevent_unsubscribe(AXEventHandler *ehandler, axevent_subscription_t *subscription)
+{
+    assert(NULL != ehandler);
+    assert(NULL != subscription);
+
+    LOG_I(
+        "%s/%s: Unsubscribing from '%s' axevent with id %u",
+        __FILE__,
+        __FUNCTION__,
+        profiles_source_name(subscription->source),
+        subscription->subid);
+    ax_event_handler_unsubscribe(ehandler, subscription->subid, NULL);
+    subscription->subid = 0;
+}
+
+gboolean axevent_setup(AXEventHandler *ehandler, const gchar *topics)
 {
     assert(NULL != ehandler);
+    assert(NULL != topics);
+
+    gchar **names = g_strsplit(topics, AXEV_SOURCE_SEPARATOR, -1);
+    gboolean result = TRUE;
+
+    for (gint source = 0; source < PROFILES_SOURCES_MAX; source++)
+    {
+        subscriptions[source].wanted = FALSE;
+    }
 
-    // Discover axevent alarms
-    subid = axevent_subscribe(ehandler, topic);
-    if (0 == subid)
+    for (gchar **name = names; NULL != *name; name++)
     {
-        LOG_E("%s/%s: Cannot subscribe to axevent '%s' for topic '%s'", __FILE__, __FUNCTION__, AXEV_ACTIVE, topic);
-        return FALSE;
+        g_strstrip(*name);
+        if ('\0' == **name)
+        {
+            continue;
+        }
+
+        gint source = profiles_source_insert(*name);
+        if (0 > source)
+        {
+            LOG_E("%s/%s: Cannot add axevent source '%s'", __FILE__, __FUNCTION__, *name);
+            result = FALSE;
+            continue;
+        }
+        subscriptions[source].source = source;
+        subscriptions[source].wanted = TRUE;
+    }
+    g_strfreev(names);
+
+    // Only touch the sources that changed, the others keep their subscription
+    // and never miss an event
+    for (gint source = 0; source < PROFILES_SOURCES_MAX; source++)
+    {
+        axevent_subscription_t *subscription = &subscriptions[source];
+
+        if (!subscription->wanted && 0 != subscription->subid)
+        {
+            axevent_unsubscribe(ehandler, subscription);
+        }
+        else if (subscription->wanted && 0 == subscription->subid)
+        {
+            // Discover axevent alarms
+            subscription->subid = axevent_subscribe(ehandler, subscription);
+            if (0 == subscription->subid)
+            {
+                LOG_E(
+                    "%s/%s: Cannot subscribe to axevent '%s' for topic '%s'",
+                    __FILE__,
+                    __FUNCTION__,
+                    AXEV_ACTIVE,
+                    profiles_source_name(source));
+                result = FALSE;
+            }
+        }
     }
-    return TRUE;
+
+    return result;
+}
+
+void axevent_set_batching(gboolean enabled)
+{
+    // Events staged so far go out before the mode changes
+    axevent_flush();
+    batching = enabled;
+}
+
+gboolean axevent_set_metadata(const gchar *spec)
+{
+    gboolean result = metadata_configure(spec);
+
+    // Events staged so far were decoded with the old keys and go out first
+    axevent_flush();
+    for (gint source = 0; source < PROFILES_SOURCES_MAX; source++)
+    {
+        if (0 != subscriptions[source].subid)
+        {
+            metadata_resolve(profiles_source_name(source), &subscriptions[source].metadata);
+        }
+    }
+
+    return result;
 }
 
 void axevent_teardown(AXEventHandler *ehandler)
 {
     assert(NULL != ehandler);
 
-    LOG_I("%s/%s: Unsubscribing from axevent with id %u", __FILE__, __FUNCTION__, subid);
-    ax_event_handler_unsubscribe(ehandler, subid, NULL);
+    if (0 != batch_source)
+    {
+        g_source_remove(batch_source);
+        batch_source = 0;
+    }
+    axevent_flush();
+
+    for (gint source = 0; source < PROFILES_SOURCES_MAX; source++)
+    {
+        if (0 != subscriptions[source].subid)
+        {
+            axevent_unsubscribe(ehandler, &subscriptions[source]);
+        }
+    }
+}
+
+void axevent_inject(const gchar *evtsource, const gchar *label, gboolean active)
+{
+    assert(NULL != evtsource);
+    assert(NULL != label);
+
+    AXEventKeyValueSet *key_value_set;
+    AXEvent *event;
+    gint source;
+
+    source = profiles_source_insert(evtsource);
+    if (0 > source)
+    {
+        LOG_E("%s/%s: Cannot add axevent source '%s'", __FILE__, __FUNCTION__, evtsource);
+        return;
+    }
+
+    // Build the event the way the event system delivers it, so that it takes
+    // the same path as a live one
+    key_value_set = ax_event_key_value_set_new();
+    if (!ax_event_key_value_set_add_key_values(
+            key_value_set,
+            NULL,
+            "topic0",
+            "tnsaxis",
+            AXEV_TNSAXIS_TOPIC0,
+            AX_VALUE_TYPE_STRING,
+            "topic1",
+            "tnsaxis",
+            evtsource,
+            AX_VALUE_TYPE_STRING,
+            "topic2",
+            "tnsaxis",
+            label,
+            AX_VALUE_TYPE_STRING,
+            AXEV_ACTIVE,
+            NULL,
+            &active,
+            AX_VALUE_TYPE_BOOL,
+            NULL))
+    {
+        LOG_E("%s/%s: Failed to build '%s' axevent for '%s'", __FILE__, __FUNCTION__, evtsource, label);
+        ax_event_key_value_set_free(key_value_set);
+        return;
+    }
+
+    event = ax_event_new2(key_value_set, NULL);
+    ax_event_key_value_set_free(key_value_set);
+
+    subscriptions[source].source = source;
+    axevent_sub_callback(0, event, &subscriptions[source]);
 }
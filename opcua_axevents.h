@@ -19,7 +19,10 @@
 
 #include <axevent.h>
 
-gboolean axevent_setup(AXEventHandler *ehandler, const gchar *topic);
+gboolean axevent_setup(AXEventHandler *ehandler, const gchar *topics);
 void axevent_teardown(AXEventHandler *ehandler);
+void axevent_set_batching(gboolean enabled);
+gboolean axevent_set_metadata(const gchar *spec);
+void axevent_inject(const gchar *source, const gchar *label, gboolean active);
 
 #endif /* _OPCUA_AXEVENTS_H_ */
@@ -0,0 +1,117 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <glib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "opcua_catalog.h"
+#include "opcua_common.h"
+#include "opcua_profiles.h"
+
+#define CATALOG_SEPARATOR ","
+
+// Handed over to the server thread
+static pthread_mutex_t request_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool requested[PROFILES_MAX];
+static atomic_bool request_pending;
+
+// Owned by the server thread
+static bool declared[PROFILES_MAX];
+
+bool catalog_configure(const char *spec)
+{
+    gchar **entries = g_strsplit((NULL != spec) ? spec : "", CATALOG_SEPARATOR, -1);
+    bool wanted[PROFILES_MAX] = {false};
+    bool result = true;
+
+    for (gchar **entry = entries; NULL != *entry; entry++)
+    {
+        g_strstrip(*entry);
+        if ('\0' == **entry)
+        {
+            continue;
+        }
+
+        // Source names have no dots, labels may
+        gchar *label = strchr(*entry, '.');
+        if (NULL == label || label == *entry || '\0' == label[1])
+        {
+            LOG_E("%s/%s: Ignoring profile '%s', expected <source>.<label>", __FILE__, __FUNCTION__, *entry);
+            result = false;
+            continue;
+        }
+        *label++ = '\0';
+
+        int source = profiles_source_insert(*entry);
+        int id = (0 > source) ? -1 : profiles_insert(source, label);
+        if (0 > id)
+        {
+            LOG_E("%s/%s: Cannot declare profile '%s.%s'", __FILE__, __FUNCTION__, *entry, label);
+            result = false;
+            continue;
+        }
+        wanted[id] = true;
+    }
+    g_strfreev(entries);
+
+    pthread_mutex_lock(&request_lock);
+    memcpy(requested, wanted, sizeof(requested));
+    pthread_mutex_unlock(&request_lock);
+
+    atomic_store(&request_pending, true);
+    return result;
+}
+
+void catalog_init(void)
+{
+    // A new server has nothing declared yet and gets the last requested set
+    memset(declared, 0, sizeof(declared));
+    atomic_store(&request_pending, true);
+}
+
+void catalog_update(catalog_change_t declare, catalog_change_t undeclare)
+{
+    assert(NULL != declare);
+    assert(NULL != undeclare);
+
+    bool wanted[PROFILES_MAX];
+
+    if (!atomic_exchange(&request_pending, false))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&request_lock);
+    memcpy(wanted, requested, sizeof(wanted));
+    pthread_mutex_unlock(&request_lock);
+
+    // Only the difference to the set applied before touches the address space
+    for (int id = 0; id < PROFILES_MAX; id++)
+    {
+        if (wanted[id] && !declared[id])
+        {
+            declare(id);
+        }
+        else if (!wanted[id] && declared[id])
+        {
+            undeclare(id);
+        }
+        declared[id] = wanted[id];
+    }
+}
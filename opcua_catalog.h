@@ -0,0 +1,44 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_CATALOG_H_
+#define _OPCUA_CATALOG_H_
+
+#include <stdbool.h>
+
+/*
+ * Profiles declared up front, so that a client connecting to a freshly
+ * started bridge finds the complete address space instead of one that
+ * grows with the first event of every profile. Entries are
+ * "<source>.<label>", i.e. the NodeIds of the profiles.
+ *
+ * The GLib main loop interns the declared profiles and hands the set over,
+ * the OPC UA server thread applies it in one go: profiles that joined the
+ * set are declared, those that left it undeclared. Profiles that are not
+ * declared are still created by their first event as before.
+ *
+ * catalog_configure belongs to the GLib main loop, catalog_init and
+ * catalog_update to the OPC UA server thread, or to the main loop before
+ * that thread is started.
+ */
+
+typedef void (*catalog_change_t)(int id);
+
+bool catalog_configure(const char *spec);
+void catalog_init(void);
+void catalog_update(catalog_change_t declare, catalog_change_t undeclare);
+
+#endif /* _OPCUA_CATALOG_H_ */
@@ -20,10 +20,14 @@
 #include <stdio.h>
 #include <syslog.h>
 
+#include "opcua_log.h"
+
 // clang-format off
-#define LOG(type, fmt, args...) { syslog(type, fmt, ##args); printf(fmt, ##args); printf("\n"); }
+#define LOG(type, fmt, args...) { if (log_enabled(type)) log_write(type, fmt, ##args); }
 #define LOG_I(fmt, args...) { LOG(LOG_INFO, fmt, ##args) }
 #define LOG_E(fmt, args...) { LOG(LOG_ERR, fmt, ##args) }
+// Per-event informational messages, subject to the eventlograte parameter
+#define LOG_EV(fmt, args...) { if (log_event_allowed()) log_write(LOG_INFO, fmt, ##args); }
 // clang-format on
 
 #endif /* _OPCUA_COMMON_H_ */
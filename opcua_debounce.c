@@ -0,0 +1,109 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "opcua_debounce.h"
+
+static atomic_int mode = DEBOUNCE_OFF;
+static atomic_uint hold_ms;
+static atomic_uint min_interval_ms;
+
+void debounce_configure(debounce_mode_t newmode, uint32_t newhold_ms, uint32_t max_rate)
+{
+    atomic_store(&mode, newmode);
+    atomic_store(&hold_ms, newhold_ms);
+    atomic_store(&min_interval_ms, 0 == max_rate ? 0 : 1000 / max_rate);
+}
+
+void debounce_reset(debounce_state_t *state, bool published, int64_t now_ms)
+{
+    assert(NULL != state);
+
+    state->raw = published;
+    state->published = published;
+    state->pending = false;
+    state->due_ms = 0;
+    state->last_publish_ms = now_ms;
+    state->toggles = 0;
+    state->publishes = 0;
+}
+
+bool debounce_event(debounce_state_t *state, bool raw, int64_t now_ms)
+{
+    assert(NULL != state);
+
+    if (state->raw == raw)
+    {
+        return false;
+    }
+    state->raw = raw;
+    state->toggles++;
+
+    // Flipped back to what clients already see, drop the pending transition
+    if (state->published == raw)
+    {
+        state->pending = false;
+        return false;
+    }
+
+    int64_t delay = 0;
+    switch (atomic_load_explicit(&mode, memory_order_relaxed))
+    {
+    case DEBOUNCE_HOLD:
+        delay = atomic_load_explicit(&hold_ms, memory_order_relaxed);
+        break;
+    case DEBOUNCE_FALLING:
+        delay = raw ? 0 : atomic_load_explicit(&hold_ms, memory_order_relaxed);
+        break;
+    default:
+        break;
+    }
+
+    int64_t due = now_ms + delay;
+    int64_t earliest = state->last_publish_ms + atomic_load_explicit(&min_interval_ms, memory_order_relaxed);
+    state->due_ms = due > earliest ? due : earliest;
+    state->pending = state->due_ms > now_ms;
+
+    return !state->pending;
+}
+
+bool debounce_due(const debounce_state_t *state, int64_t now_ms)
+{
+    assert(NULL != state);
+
+    return state->pending && state->due_ms <= now_ms;
+}
+
+void debounce_published(debounce_state_t *state, int64_t now_ms)
+{
+    assert(NULL != state);
+
+    state->published = state->raw;
+    state->pending = false;
+    state->last_publish_ms = now_ms;
+    state->publishes++;
+}
+
+uint32_t debounce_suppressed(const debounce_state_t *state)
+{
+    assert(NULL != state);
+
+    // Transitions still pending are not counted as suppressed yet
+    return state->toggles - state->publishes - (state->pending ? 1 : 0);
+}
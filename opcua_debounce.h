@@ -0,0 +1,59 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_DEBOUNCE_H_
+#define _OPCUA_DEBOUNCE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Per-profile coalescing of flapping alarms. Every raw transition is
+ * counted, but a transition is only published once it has been stable for
+ * the hold time (in DEBOUNCE_HOLD mode, or for falling edges only in
+ * DEBOUNCE_FALLING mode) and no sooner than the max publish rate allows.
+ * A state that flips back before it was published is never published.
+ *
+ * The configuration may be changed from any thread, the per-profile state
+ * belongs to the OPC UA server thread.
+ */
+
+typedef enum
+{
+    DEBOUNCE_OFF,
+    DEBOUNCE_HOLD,
+    DEBOUNCE_FALLING,
+} debounce_mode_t;
+
+typedef struct
+{
+    bool raw;
+    bool published;
+    bool pending;
+    int64_t due_ms;
+    int64_t last_publish_ms;
+    uint32_t toggles;
+    uint32_t publishes;
+} debounce_state_t;
+
+void debounce_configure(debounce_mode_t mode, uint32_t hold_ms, uint32_t max_rate);
+void debounce_reset(debounce_state_t *state, bool published, int64_t now_ms);
+bool debounce_event(debounce_state_t *state, bool raw, int64_t now_ms);
+bool debounce_due(const debounce_state_t *state, int64_t now_ms);
+void debounce_published(debounce_state_t *state, int64_t now_ms);
+uint32_t debounce_suppressed(const debounce_state_t *state);
+
+#endif /* _OPCUA_DEBOUNCE_H_ */
@@ -0,0 +1,311 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "opcua_diagnostics.h"
+#include "opcua_evqueue.h"
+#include "opcua_profiles.h"
+
+#define DIAGNOSTICS_NAME_SIZE 64
+
+typedef enum
+{
+    DIAGNOSTICS_FIELD_EVENTS_RECEIVED,
+    DIAGNOSTICS_FIELD_EVENTS_DROPPED,
+    DIAGNOSTICS_FIELD_EVENTS_COALESCED,
+    DIAGNOSTICS_FIELD_NODES_CREATED,
+    DIAGNOSTICS_FIELD_QUEUE_DEPTH,
+    DIAGNOSTICS_FIELD_QUEUE_HIGHWATER,
+    DIAGNOSTICS_FIELD_PROFILE_NAMES,
+    DIAGNOSTICS_FIELD_PROFILE_TRANSITIONS,
+    DIAGNOSTICS_FIELD_PROCESSING_MIN,
+    DIAGNOSTICS_FIELD_PROCESSING_AVG,
+    DIAGNOSTICS_FIELD_PROCESSING_MAX,
+    DIAGNOSTICS_FIELD_ITERATION_MIN,
+    DIAGNOSTICS_FIELD_ITERATION_AVG,
+    DIAGNOSTICS_FIELD_ITERATION_MAX,
+    DIAGNOSTICS_FIELD_SESSIONS,
+    DIAGNOSTICS_FIELD_RESIDENT_MEMORY,
+    DIAGNOSTICS_FIELDS,
+} diagnostics_field_t;
+
+typedef struct
+{
+    diagnostics_field_t field;
+    char *name;
+    char *description;
+    int type;
+    bool array;
+} diagnostics_node_t;
+
+typedef struct
+{
+    uint64_t count;
+    int64_t total_ns;
+    int64_t min_ns;
+    int64_t max_ns;
+} diagnostics_timing_t;
+
+// Node context of every exposed variable
+static diagnostics_node_t nodes[DIAGNOSTICS_FIELDS] = {
+    {DIAGNOSTICS_FIELD_EVENTS_RECEIVED, "EventsReceived", "Axevents received", UA_TYPES_UINT64, false},
+    {DIAGNOSTICS_FIELD_EVENTS_DROPPED, "EventsDropped", "Axevents dropped on a full queue", UA_TYPES_UINT64, false},
+    {DIAGNOSTICS_FIELD_EVENTS_COALESCED,
+     "EventsCoalesced",
+     "Transitions folded by the debounce stage",
+     UA_TYPES_UINT64,
+     false},
+    {DIAGNOSTICS_FIELD_NODES_CREATED, "NodesCreated", "Profile nodes created", UA_TYPES_UINT64, false},
+    {DIAGNOSTICS_FIELD_QUEUE_DEPTH, "QueueDepth", "Axevents waiting for the server", UA_TYPES_UINT64, false},
+    {DIAGNOSTICS_FIELD_QUEUE_HIGHWATER, "QueueHighWater", "Largest queue depth seen", UA_TYPES_UINT64, false},
+    {DIAGNOSTICS_FIELD_PROFILE_NAMES, "ProfileNames", "NodeId names by profile", UA_TYPES_STRING, true},
+    {DIAGNOSTICS_FIELD_PROFILE_TRANSITIONS,
+     "ProfileTransitions",
+     "Raw state changes by profile",
+     UA_TYPES_UINT32,
+     true},
+    {DIAGNOSTICS_FIELD_PROCESSING_MIN, "ProcessingTimeMin", "Microseconds per axevent", UA_TYPES_DOUBLE, false},
+    {DIAGNOSTICS_FIELD_PROCESSING_AVG, "ProcessingTimeAvg", "Microseconds per axevent", UA_TYPES_DOUBLE, false},
+    {DIAGNOSTICS_FIELD_PROCESSING_MAX, "ProcessingTimeMax", "Microseconds per axevent", UA_TYPES_DOUBLE, false},
+    {DIAGNOSTICS_FIELD_ITERATION_MIN, "IterationTimeMin", "Microseconds per drain round", UA_TYPES_DOUBLE, false},
+    {DIAGNOSTICS_FIELD_ITERATION_AVG, "IterationTimeAvg", "Microseconds per drain round", UA_TYPES_DOUBLE, false},
+    {DIAGNOSTICS_FIELD_ITERATION_MAX, "IterationTimeMax", "Microseconds per drain round", UA_TYPES_DOUBLE, false},
+    {DIAGNOSTICS_FIELD_SESSIONS, "SessionCount", "Open client sessions", UA_TYPES_UINT32, false},
+    {DIAGNOSTICS_FIELD_RESIDENT_MEMORY, "ResidentMemory", "Resident memory in kB", UA_TYPES_UINT64, false},
+};
+
+atomic_uint_fast64_t diagnostics_counters[DIAGNOSTICS_COUNTERS];
+
+static uint32_t transitions[PROFILES_MAX];
+static diagnostics_timing_t processing;
+static diagnostics_timing_t iteration;
+
+static void diagnostics_time(diagnostics_timing_t *timing, int64_t elapsed_ns)
+{
+    // Extremes of single measurements since the start, never reset
+    if (0 == timing->count || elapsed_ns < timing->min_ns)
+    {
+        timing->min_ns = elapsed_ns;
+    }
+    if (elapsed_ns > timing->max_ns)
+    {
+        timing->max_ns = elapsed_ns;
+    }
+    timing->total_ns += elapsed_ns;
+    timing->count++;
+}
+
+void diagnostics_transition(int id)
+{
+    assert(0 <= id && PROFILES_MAX > id);
+
+    transitions[id]++;
+    diagnostics_count(DIAGNOSTICS_TRANSITIONS);
+}
+
+void diagnostics_processed(int64_t elapsed_ns)
+{
+    diagnostics_time(&processing, elapsed_ns);
+}
+
+void diagnostics_iteration(int64_t elapsed_ns)
+{
+    diagnostics_time(&iteration, elapsed_ns);
+}
+
+static uint64_t diagnostics_counter(diagnostics_counter_t counter)
+{
+    return atomic_load_explicit(&diagnostics_counters[counter], memory_order_relaxed);
+}
+
+static uint64_t diagnostics_resident_kb(void)
+{
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+
+    if (NULL != statm)
+    {
+        if (2 != fscanf(statm, "%lu %lu", &size, &resident))
+        {
+            resident = 0;
+        }
+        (void)fclose(statm);
+    }
+    return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE) / 1024;
+}
+
+static double diagnostics_us(const diagnostics_timing_t *timing, diagnostics_field_t field, diagnostics_field_t first)
+{
+    if (0 == timing->count)
+    {
+        return 0.0;
+    }
+
+    // The fields of a timing are declared in min, avg, max order
+    switch (field - first)
+    {
+    case 0:
+        return timing->min_ns / 1e3;
+    case 1:
+        return timing->total_ns / 1e3 / timing->count;
+    default:
+        return timing->max_ns / 1e3;
+    }
+}
+
+static UA_StatusCode diagnostics_read_profiles(const diagnostics_node_t *node, UA_Variant *value)
+{
+    size_t count = profiles_count();
+
+    if (DIAGNOSTICS_FIELD_PROFILE_TRANSITIONS == node->field)
+    {
+        return UA_Variant_setArrayCopy(value, transitions, count, &UA_TYPES[UA_TYPES_UINT32]);
+    }
+
+    UA_String names[PROFILES_MAX];
+    for (size_t id = 0; id < count; id++)
+    {
+        names[id] = UA_STRING((char *)profiles_node_name(id));
+    }
+    return UA_Variant_setArrayCopy(value, names, count, &UA_TYPES[UA_TYPES_STRING]);
+}
+
+static UA_StatusCode diagnostics_read(
+    UA_Server *server,
+    const UA_NodeId *session_id,
+    void *session_context,
+    const UA_NodeId *node_id,
+    void *node_context,
+    UA_Boolean source_timestamp,
+    const UA_NumericRange *range,
+    UA_DataValue *value)
+{
+    const diagnostics_node_t *node = node_context;
+    evqueue_stats_t queue;
+    UA_UInt64 number = 0;
+    UA_Double time = 0.0;
+    UA_UInt32 sessions;
+
+    (void)session_id;
+    (void)session_context;
+    (void)node_id;
+    (void)source_timestamp;
+    (void)range;
+
+    value->hasValue = true;
+    switch (node->field)
+    {
+    case DIAGNOSTICS_FIELD_EVENTS_RECEIVED:
+        number = diagnostics_counter(DIAGNOSTICS_EVENTS_RECEIVED);
+        break;
+    case DIAGNOSTICS_FIELD_EVENTS_DROPPED:
+        evqueue_get_stats(&queue);
+        number = queue.dropped;
+        break;
+    case DIAGNOSTICS_FIELD_EVENTS_COALESCED:
+        number = diagnostics_counter(DIAGNOSTICS_TRANSITIONS) - diagnostics_counter(DIAGNOSTICS_PUBLISHES);
+        break;
+    case DIAGNOSTICS_FIELD_NODES_CREATED:
+        number = diagnostics_counter(DIAGNOSTICS_NODES_CREATED);
+        break;
+    case DIAGNOSTICS_FIELD_QUEUE_DEPTH:
+        evqueue_get_stats(&queue);
+        number = queue.depth;
+        break;
+    case DIAGNOSTICS_FIELD_QUEUE_HIGHWATER:
+        evqueue_get_stats(&queue);
+        number = queue.highwater;
+        break;
+    case DIAGNOSTICS_FIELD_PROFILE_NAMES:
+    case DIAGNOSTICS_FIELD_PROFILE_TRANSITIONS:
+        return diagnostics_read_profiles(node, &value->value);
+    case DIAGNOSTICS_FIELD_PROCESSING_MIN:
+    case DIAGNOSTICS_FIELD_PROCESSING_AVG:
+    case DIAGNOSTICS_FIELD_PROCESSING_MAX:
+        time = diagnostics_us(&processing, node->field, DIAGNOSTICS_FIELD_PROCESSING_MIN);
+        return UA_Variant_setScalarCopy(&value->value, &time, &UA_TYPES[UA_TYPES_DOUBLE]);
+    case DIAGNOSTICS_FIELD_ITERATION_MIN:
+    case DIAGNOSTICS_FIELD_ITERATION_AVG:
+    case DIAGNOSTICS_FIELD_ITERATION_MAX:
+        time = diagnostics_us(&iteration, node->field, DIAGNOSTICS_FIELD_ITERATION_MIN);
+        return UA_Variant_setScalarCopy(&value->value, &time, &UA_TYPES[UA_TYPES_DOUBLE]);
+    case DIAGNOSTICS_FIELD_SESSIONS:
+        sessions = UA_Server_getStatistics(server).ss.currentSessionCount;
+        return UA_Variant_setScalarCopy(&value->value, &sessions, &UA_TYPES[UA_TYPES_UINT32]);
+    default:
+        number = diagnostics_resident_kb();
+        break;
+    }
+    return UA_Variant_setScalarCopy(&value->value, &number, &UA_TYPES[UA_TYPES_UINT64]);
+}
+
+UA_StatusCode diagnostics_add_nodes(UA_Server *server)
+{
+    assert(NULL != server);
+
+    UA_ObjectAttributes object_attr = UA_ObjectAttributes_default;
+    UA_DataSource source = {diagnostics_read, NULL};
+    UA_NodeId diagnostics_id = UA_NODEID_STRING(1, "Diagnostics");
+    UA_StatusCode status;
+
+    object_attr.displayName = UA_LOCALIZEDTEXT("en-US", "Diagnostics");
+    object_attr.description = UA_LOCALIZEDTEXT("en-US", "Performance counters of the bridge");
+    status = UA_Server_addObjectNode(
+        server,
+        diagnostics_id,
+        UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+        UA_QUALIFIEDNAME(1, "Diagnostics"),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+        object_attr,
+        NULL,
+        NULL);
+
+    for (int field = 0; field < DIAGNOSTICS_FIELDS && UA_STATUSCODE_GOOD == status; field++)
+    {
+        UA_VariableAttributes attr = UA_VariableAttributes_default;
+        diagnostics_node_t *node = &nodes[field];
+        char name[DIAGNOSTICS_NAME_SIZE];
+
+        assert(field == (int)node->field);
+
+        attr.displayName = UA_LOCALIZEDTEXT("en-US", node->name);
+        attr.description = UA_LOCALIZEDTEXT("en-US", node->description);
+        attr.dataType = UA_TYPES[node->type].typeId;
+        attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+        attr.valueRank = node->array ? UA_VALUERANK_ONE_DIMENSION : UA_VALUERANK_SCALAR;
+
+        // The string NodeId is copied by the server
+        (void)snprintf(name, sizeof(name), "Diagnostics.%s", node->name);
+        status = UA_Server_addDataSourceVariableNode(
+            server,
+            UA_NODEID_STRING(1, name),
+            diagnostics_id,
+            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+            UA_QUALIFIEDNAME(1, node->name),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+            attr,
+            source,
+            node,
+            NULL);
+    }
+
+    return status;
+}
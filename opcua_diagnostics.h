@@ -0,0 +1,57 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_DIAGNOSTICS_H_
+#define _OPCUA_DIAGNOSTICS_H_
+
+#include <open62541/server.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Performance counters of the bridge itself, exposed as variables of a
+ * Diagnostics object in namespace 1 (string NodeIds "Diagnostics.<Name>").
+ *
+ * The hot paths only bump relaxed atomic counters, everything derived from
+ * them (coalesced events, averages, queue depth, sessions, memory) is
+ * computed when a client reads the variable.
+ *
+ * diagnostics_count may be called from any thread, the rest belongs to the
+ * OPC UA server thread.
+ */
+
+typedef enum
+{
+    DIAGNOSTICS_EVENTS_RECEIVED,
+    DIAGNOSTICS_NODES_CREATED,
+    DIAGNOSTICS_TRANSITIONS,
+    DIAGNOSTICS_PUBLISHES,
+    DIAGNOSTICS_COUNTERS,
+} diagnostics_counter_t;
+
+extern atomic_uint_fast64_t diagnostics_counters[DIAGNOSTICS_COUNTERS];
+
+static inline void diagnostics_count(diagnostics_counter_t counter)
+{
+    atomic_fetch_add_explicit(&diagnostics_counters[counter], 1, memory_order_relaxed);
+}
+
+void diagnostics_transition(int id);
+void diagnostics_processed(int64_t elapsed_ns);
+void diagnostics_iteration(int64_t elapsed_ns);
+UA_StatusCode diagnostics_add_nodes(UA_Server *server);
+
+#endif /* _OPCUA_DIAGNOSTICS_H_ */
@@ -0,0 +1,216 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <open62541/server_config_default.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "opcua_common.h"
+#include "opcua_engine.h"
+
+// open62541 rejects publishing intervals below this
+#define ENGINE_PUBLISHING_MS_FLOOR 5
+
+static const char *profile_names[ENGINE_PROFILES] = {"Default", "LowLatency", "ManyClients"};
+
+// Knob values of every profile, 0 keeps the library default
+static const uint32_t profile_knobs[ENGINE_PROFILES][ENGINE_KNOBS] = {
+    [ENGINE_DEFAULT] = {0},
+    // Short intervals for a handful of SCADA/PLC clients
+    [ENGINE_LOW_LATENCY] =
+        {
+            [ENGINE_MIN_SAMPLING_MS] = 5,
+            [ENGINE_MIN_PUBLISHING_MS] = 5,
+            [ENGINE_MAX_SESSIONS] = 10,
+            [ENGINE_MAX_SUBSCRIPTIONS] = 20,
+        },
+    // Long intervals and rare timer wakeups batch more work per iteration,
+    // short queues and smaller buffers keep the memory per connection down
+    // so that a client that stops reading costs a bounded amount
+    [ENGINE_MANY_CLIENTS] =
+        {
+            [ENGINE_MIN_SAMPLING_MS] = 250,
+            [ENGINE_MIN_PUBLISHING_MS] = 500,
+            [ENGINE_MAX_SESSIONS] = 200,
+            [ENGINE_MAX_SUBSCRIPTIONS] = 400,
+            [ENGINE_MAX_MONITORED_ITEMS] = 100000,
+            [ENGINE_MAX_QUEUE_SIZE] = 10,
+            [ENGINE_MAX_NOTIFICATIONS] = 500,
+            [ENGINE_MAX_RETRANSMISSION] = 8,
+            [ENGINE_NETWORK_BUFFER] = 16384,
+            [ENGINE_WAKEUP_MS] = 25,
+        },
+};
+
+// Configuration handed over to the server thread, overrides of 0 are unset
+static pthread_mutex_t request_lock = PTHREAD_MUTEX_INITIALIZER;
+static engine_profile_t request_profile;
+static uint32_t request_overrides[ENGINE_KNOBS];
+static atomic_bool request_pending;
+
+// Owned by the server thread
+static engine_profile_t active_profile;
+static uint32_t active[ENGINE_KNOBS];
+static uint32_t defaults[ENGINE_KNOBS];
+static UA_UInt32 default_channels;
+
+void engine_request_profile(engine_profile_t profile)
+{
+    assert(ENGINE_PROFILES > profile);
+
+    pthread_mutex_lock(&request_lock);
+    request_profile = profile;
+    pthread_mutex_unlock(&request_lock);
+
+    atomic_store(&request_pending, true);
+}
+
+void engine_request_knob(engine_knob_t knob, uint32_t value)
+{
+    assert(ENGINE_KNOBS > knob);
+
+    pthread_mutex_lock(&request_lock);
+    request_overrides[knob] = value;
+    pthread_mutex_unlock(&request_lock);
+
+    atomic_store(&request_pending, true);
+}
+
+static void engine_resolve(void)
+{
+    uint32_t overrides[ENGINE_KNOBS];
+
+    pthread_mutex_lock(&request_lock);
+    active_profile = request_profile;
+    memcpy(overrides, request_overrides, sizeof(overrides));
+    pthread_mutex_unlock(&request_lock);
+
+    for (int knob = 0; knob < ENGINE_KNOBS; knob++)
+    {
+        active[knob] = overrides[knob];
+        if (0 == active[knob])
+        {
+            active[knob] = profile_knobs[active_profile][knob];
+        }
+        if (0 == active[knob])
+        {
+            active[knob] = defaults[knob];
+        }
+    }
+    if (ENGINE_PUBLISHING_MS_FLOOR > active[ENGINE_MIN_PUBLISHING_MS])
+    {
+        active[ENGINE_MIN_PUBLISHING_MS] = ENGINE_PUBLISHING_MS_FLOOR;
+    }
+}
+
+static void engine_apply(UA_ServerConfig *config)
+{
+    // Only the lower interval limits move, clients may still ask for slower
+    config->samplingIntervalLimits.min = active[ENGINE_MIN_SAMPLING_MS];
+    config->publishingIntervalLimits.min = active[ENGINE_MIN_PUBLISHING_MS];
+
+    // Every session needs a secure channel of its own
+    config->maxSessions = (UA_UInt16)active[ENGINE_MAX_SESSIONS];
+    config->maxSecureChannels =
+        (UA_UInt16)(default_channels > active[ENGINE_MAX_SESSIONS] ? default_channels : active[ENGINE_MAX_SESSIONS]);
+    config->maxSubscriptions = active[ENGINE_MAX_SUBSCRIPTIONS];
+    config->maxMonitoredItems = active[ENGINE_MAX_MONITORED_ITEMS];
+
+    // A slow client loses the oldest notifications instead of growing them
+    config->queueSizeLimits.max = active[ENGINE_MAX_QUEUE_SIZE];
+    config->maxNotificationsPerPublish = active[ENGINE_MAX_NOTIFICATIONS];
+    config->maxRetransmissionQueueSize = active[ENGINE_MAX_RETRANSMISSION];
+
+    LOG_I(
+        "%s/%s: Server engine profile %s: sampling >= %u ms, publishing >= %u ms, %u sessions, %u subscriptions, "
+        "%u monitored items, queue <= %u, %u notifications, %u retransmissions, network buffer %u, wakeup %u ms",
+        __FILE__,
+        __FUNCTION__,
+        profile_names[active_profile],
+        active[ENGINE_MIN_SAMPLING_MS],
+        active[ENGINE_MIN_PUBLISHING_MS],
+        active[ENGINE_MAX_SESSIONS],
+        active[ENGINE_MAX_SUBSCRIPTIONS],
+        active[ENGINE_MAX_MONITORED_ITEMS],
+        active[ENGINE_MAX_QUEUE_SIZE],
+        active[ENGINE_MAX_NOTIFICATIONS],
+        active[ENGINE_MAX_RETRANSMISSION],
+        active[ENGINE_NETWORK_BUFFER],
+        active[ENGINE_WAKEUP_MS]);
+}
+
+UA_StatusCode engine_setup(UA_ServerConfig *config, UA_UInt16 port)
+{
+    assert(NULL != config);
+
+    // Requests from here on are applied by engine_update
+    atomic_store(&request_pending, false);
+    engine_resolve();
+
+    UA_StatusCode status = UA_ServerConfig_setMinimalCustomBuffer(
+        config,
+        port,
+        NULL,
+        active[ENGINE_NETWORK_BUFFER],
+        active[ENGINE_NETWORK_BUFFER]);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        return status;
+    }
+
+    // The minimal configuration is what a knob left unset falls back to
+    defaults[ENGINE_MIN_SAMPLING_MS] = (uint32_t)config->samplingIntervalLimits.min;
+    defaults[ENGINE_MIN_PUBLISHING_MS] = (uint32_t)config->publishingIntervalLimits.min;
+    defaults[ENGINE_MAX_SESSIONS] = config->maxSessions;
+    defaults[ENGINE_MAX_SUBSCRIPTIONS] = config->maxSubscriptions;
+    defaults[ENGINE_MAX_MONITORED_ITEMS] = config->maxMonitoredItems;
+    defaults[ENGINE_MAX_QUEUE_SIZE] = config->queueSizeLimits.max;
+    defaults[ENGINE_MAX_NOTIFICATIONS] = config->maxNotificationsPerPublish;
+    defaults[ENGINE_MAX_RETRANSMISSION] = ENGINE_RETRANSMISSION_DEFAULT;
+    defaults[ENGINE_NETWORK_BUFFER] = 0;
+    defaults[ENGINE_WAKEUP_MS] = ENGINE_WAKEUP_MS_DEFAULT;
+    default_channels = config->maxSecureChannels;
+
+    engine_resolve();
+    engine_apply(config);
+    return UA_STATUSCODE_GOOD;
+}
+
+bool engine_update(UA_ServerConfig *config, bool *relisten)
+{
+    assert(NULL != config);
+    assert(NULL != relisten);
+
+    if (!atomic_exchange(&request_pending, false))
+    {
+        return false;
+    }
+
+    uint32_t buffer = active[ENGINE_NETWORK_BUFFER];
+    engine_resolve();
+    engine_apply(config);
+    *relisten = buffer != active[ENGINE_NETWORK_BUFFER];
+    return true;
+}
+
+uint32_t engine_get(engine_knob_t knob)
+{
+    assert(ENGINE_KNOBS > knob);
+
+    return active[knob];
+}
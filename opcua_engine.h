@@ -0,0 +1,73 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_ENGINE_H_
+#define _OPCUA_ENGINE_H_
+
+#include <open62541/server.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Tuning of the OPC UA server engine on top of the minimal open62541
+ * configuration: the sampling and publishing interval limits, the session,
+ * subscription and monitored item limits, how many notifications a client
+ * may have queued, the network buffer sizes and how often the server thread
+ * wakes up when no axevent woke it, to time the debounce holds.
+ *
+ * Every knob is taken from the selected profile unless it is overridden,
+ * and a knob neither sets keeps the library default. Changes are picked up
+ * by the running server, existing sessions and subscriptions keep what was
+ * revised for them and a new network buffer size reopens the listener.
+ *
+ * engine_request_* may be called from any thread, the rest belongs to the
+ * OPC UA server thread.
+ */
+
+#define ENGINE_WAKEUP_MS_DEFAULT 10
+// open62541 keeps every unacknowledged notification message, the bridge does not
+#define ENGINE_RETRANSMISSION_DEFAULT 64
+
+typedef enum
+{
+    ENGINE_DEFAULT, // library defaults
+    ENGINE_LOW_LATENCY, // few clients, notifications as soon as possible
+    ENGINE_MANY_CLIENTS, // many clients, little CPU per event
+    ENGINE_PROFILES
+} engine_profile_t;
+
+typedef enum
+{
+    ENGINE_MIN_SAMPLING_MS,
+    ENGINE_MIN_PUBLISHING_MS,
+    ENGINE_MAX_SESSIONS,
+    ENGINE_MAX_SUBSCRIPTIONS,
+    ENGINE_MAX_MONITORED_ITEMS,
+    ENGINE_MAX_QUEUE_SIZE, // notifications queued per monitored item
+    ENGINE_MAX_NOTIFICATIONS, // notifications per publish response
+    ENGINE_MAX_RETRANSMISSION, // unacknowledged publish responses per subscription
+    ENGINE_NETWORK_BUFFER, // bytes, for both directions, 0 for the library default
+    ENGINE_WAKEUP_MS,
+    ENGINE_KNOBS
+} engine_knob_t;
+
+void engine_request_profile(engine_profile_t profile);
+void engine_request_knob(engine_knob_t knob, uint32_t value);
+UA_StatusCode engine_setup(UA_ServerConfig *config, UA_UInt16 port);
+bool engine_update(UA_ServerConfig *config, bool *relisten);
+uint32_t engine_get(engine_knob_t knob);
+
+#endif /* _OPCUA_ENGINE_H_ */
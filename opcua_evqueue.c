@@ -0,0 +1,113 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdatomic.h>
+
+#include "opcua_evqueue.h"
+
+#define EVQUEUE_MASK (EVQUEUE_CAPACITY - 1)
+#define CACHELINE_SIZE 64
+
+_Static_assert(0 == (EVQUEUE_CAPACITY & EVQUEUE_MASK), "EVQUEUE_CAPACITY must be a power of two");
+
+/*
+ * The producer owns head and its counters, the consumer owns tail. They are
+ * kept on separate cache lines so the two threads do not false share.
+ */
+static struct
+{
+    _Alignas(CACHELINE_SIZE) atomic_size_t head;
+    atomic_size_t highwater;
+    atomic_uint_fast64_t pushed;
+    atomic_uint_fast64_t dropped;
+    _Alignas(CACHELINE_SIZE) atomic_size_t tail;
+    _Alignas(CACHELINE_SIZE) evqueue_record_t records[EVQUEUE_CAPACITY];
+} queue;
+
+size_t evqueue_push_batch(const evqueue_record_t *records, size_t count)
+{
+    assert(NULL != records || 0 == count);
+
+    size_t head = atomic_load_explicit(&queue.head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue.tail, memory_order_acquire);
+    size_t depth = head - tail;
+    size_t pushed = (EVQUEUE_CAPACITY - depth < count) ? EVQUEUE_CAPACITY - depth : count;
+
+    for (size_t i = 0; i < pushed; i++)
+    {
+        queue.records[(head + i) & EVQUEUE_MASK] = records[i];
+    }
+
+    // Publish the whole burst at once, the consumer sees all of it or none
+    atomic_store_explicit(&queue.head, head + pushed, memory_order_release);
+    atomic_fetch_add_explicit(&queue.pushed, pushed, memory_order_relaxed);
+    if (pushed < count)
+    {
+        atomic_fetch_add_explicit(&queue.dropped, count - pushed, memory_order_relaxed);
+    }
+
+    if (depth + pushed > atomic_load_explicit(&queue.highwater, memory_order_relaxed))
+    {
+        atomic_store_explicit(&queue.highwater, depth + pushed, memory_order_relaxed);
+    }
+
+    return pushed;
+}
+
+bool evqueue_push(const evqueue_record_t *record)
+{
+    assert(NULL != record);
+
+    return 1 == evqueue_push_batch(record, 1);
+}
+
+size_t evqueue_pop_batch(evqueue_record_t *records, size_t max)
+{
+    assert(NULL != records);
+
+    size_t tail = atomic_load_explicit(&queue.tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue.head, memory_order_acquire);
+    size_t count = head - tail;
+
+    if (count > max)
+    {
+        count = max;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        records[i] = queue.records[(tail + i) & EVQUEUE_MASK];
+    }
+
+    // Hand the slots back to the producer in one go
+    atomic_store_explicit(&queue.tail, tail + count, memory_order_release);
+
+    return count;
+}
+
+void evqueue_get_stats(evqueue_stats_t *stats)
+{
+    assert(NULL != stats);
+
+    size_t tail = atomic_load_explicit(&queue.tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&queue.head, memory_order_acquire);
+
+    stats->depth = head - tail;
+    stats->highwater = atomic_load_explicit(&queue.highwater, memory_order_relaxed);
+    stats->pushed = atomic_load_explicit(&queue.pushed, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&queue.dropped, memory_order_relaxed);
+}
@@ -0,0 +1,63 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_EVQUEUE_H_
+#define _OPCUA_EVQUEUE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "opcua_metadata.h"
+
+/*
+ * Bounded single-producer/single-consumer queue handing decoded axevents
+ * from the GLib main loop (producer) to the OPC UA server thread (consumer).
+ * Neither side ever blocks; when the queue is full new events are dropped
+ * and counted. A batch pushed in one call becomes visible to the consumer
+ * as a whole, so a burst of events is applied in one server iteration.
+ */
+
+// Must be a power of two
+#define EVQUEUE_CAPACITY 1024
+
+// Labels are interned by the producer, only the profile id is queued.
+// timestamp is the axevent's own time (unix epoch, us) and received the
+// monotonic time (ns) it reached the axevent callback. metadata holds the
+// configured keys the event carried, decoded by the producer.
+typedef struct
+{
+    int64_t timestamp;
+    int64_t received;
+    uint16_t profile;
+    bool active;
+    metadata_record_t metadata;
+} evqueue_record_t;
+
+typedef struct
+{
+    size_t depth;
+    size_t highwater;
+    uint64_t pushed;
+    uint64_t dropped;
+} evqueue_stats_t;
+
+bool evqueue_push(const evqueue_record_t *record);
+size_t evqueue_push_batch(const evqueue_record_t *records, size_t count);
+size_t evqueue_pop_batch(evqueue_record_t *records, size_t max);
+void evqueue_get_stats(evqueue_stats_t *stats);
+
+#endif /* _OPCUA_EVQUEUE_H_ */
@@ -0,0 +1,312 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <glib-unix.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "opcua_common.h"
+#include "opcua_diagnostics.h"
+#include "opcua_export.h"
+#include "opcua_profiles.h"
+
+#define EXPORT_RING_MASK (EXPORT_RING_SIZE - 1)
+#define EXPORT_BACKLOG 4
+
+_Static_assert(0 == (EXPORT_RING_SIZE & EXPORT_RING_MASK), "EXPORT_RING_SIZE must be a power of two");
+
+typedef struct
+{
+    int fd;
+    guint watch; // hangup and errors, 0 when the slot is free
+    guint out_watch; // while the ring holds records the socket did not take
+    size_t announced; // profiles announced so far, ids are dense
+    size_t head;
+    size_t tail;
+    uint32_t dropped;
+    uint64_t sent;
+    export_record_t ring[EXPORT_RING_SIZE];
+} export_subscriber_t;
+
+static export_subscriber_t subscribers[EXPORT_SUBSCRIBERS_MAX];
+static size_t subscriber_count;
+static int listen_fd = -1;
+static guint listen_watch;
+static gchar *socket_path;
+
+static void export_close(export_subscriber_t *subscriber)
+{
+    LOG_I(
+        "%s/%s: Export subscriber left after %llu records, %u dropped",
+        __FILE__,
+        __FUNCTION__,
+        (unsigned long long)subscriber->sent,
+        subscriber->dropped);
+
+    if (0 != subscriber->watch)
+    {
+        g_source_remove(subscriber->watch);
+    }
+    if (0 != subscriber->out_watch)
+    {
+        g_source_remove(subscriber->out_watch);
+    }
+    close(subscriber->fd);
+    memset(subscriber, 0, sizeof(*subscriber));
+    subscriber_count--;
+}
+
+// 1 when sent, 0 when the socket is full, -1 when the subscriber is gone
+static int export_send(int fd, const void *message, size_t size)
+{
+    ssize_t sent = send(fd, message, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (0 <= sent && (size_t)sent == size)
+    {
+        return 1;
+    }
+    return (0 > sent && (EAGAIN == errno || EWOULDBLOCK == errno)) ? 0 : -1;
+}
+
+static gboolean export_writable(gint fd, GIOCondition condition, gpointer data);
+
+static void export_flush(export_subscriber_t *subscriber)
+{
+    int result = 1;
+
+    while (subscriber->tail != subscriber->head && 0 < result)
+    {
+        export_record_t *record = &subscriber->ring[subscriber->tail & EXPORT_RING_MASK];
+
+        // Names first, so that a subscriber never sees an unknown id
+        while (subscriber->announced <= record->profile && 0 < result)
+        {
+            export_profile_t profile = {EXPORT_PROFILE, 0, (uint16_t)subscriber->announced, {0}};
+            const char *name = profiles_node_name(subscriber->announced);
+
+            profile.length = (uint8_t)MIN(strlen(name), sizeof(profile.name));
+            memcpy(profile.name, name, profile.length);
+            result = export_send(subscriber->fd, &profile, sizeof(profile));
+            subscriber->announced += (0 < result) ? 1 : 0;
+        }
+        if (0 >= result)
+        {
+            break;
+        }
+
+        record->dropped = subscriber->dropped;
+        result = export_send(subscriber->fd, record, sizeof(*record));
+        if (0 < result)
+        {
+            subscriber->tail++;
+            subscriber->sent++;
+        }
+    }
+
+    if (0 > result)
+    {
+        export_close(subscriber);
+    }
+    else if (0 == result && 0 == subscriber->out_watch)
+    {
+        // Resumed once the subscriber has read some
+        subscriber->out_watch = g_unix_fd_add(subscriber->fd, G_IO_OUT, export_writable, subscriber);
+    }
+    else if (0 < result && 0 != subscriber->out_watch)
+    {
+        g_source_remove(subscriber->out_watch);
+        subscriber->out_watch = 0;
+    }
+}
+
+static gboolean export_writable(gint fd, GIOCondition condition, gpointer data)
+{
+    export_subscriber_t *subscriber = data;
+
+    (void)fd;
+    (void)condition;
+
+    // Added again by the flush if the socket is still full
+    subscriber->out_watch = 0;
+    export_flush(subscriber);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean export_readable(gint fd, GIOCondition condition, gpointer data)
+{
+    export_subscriber_t *subscriber = data;
+    char message[sizeof(export_profile_t)];
+    ssize_t size;
+
+    (void)condition;
+
+    // Subscribers have nothing to say, anything but data means they left
+    size = recv(fd, message, sizeof(message), MSG_DONTWAIT);
+    if (0 < size || (0 > size && (EAGAIN == errno || EWOULDBLOCK == errno)))
+    {
+        return G_SOURCE_CONTINUE;
+    }
+    subscriber->watch = 0;
+    export_close(subscriber);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean export_accept(gint fd, GIOCondition condition, gpointer data)
+{
+    export_subscriber_t *subscriber = NULL;
+    int subscriber_fd;
+
+    (void)condition;
+    (void)data;
+
+    // Blocking is fine, every send and receive asks not to wait
+    subscriber_fd = accept(fd, NULL, NULL);
+    if (0 > subscriber_fd)
+    {
+        return G_SOURCE_CONTINUE;
+    }
+
+    for (size_t i = 0; i < EXPORT_SUBSCRIBERS_MAX && NULL == subscriber; i++)
+    {
+        if (0 == subscribers[i].watch)
+        {
+            subscriber = &subscribers[i];
+        }
+    }
+    if (NULL == subscriber)
+    {
+        LOG_E("%s/%s: Export subscribers limited to %d", __FILE__, __FUNCTION__, EXPORT_SUBSCRIBERS_MAX);
+        close(subscriber_fd);
+        return G_SOURCE_CONTINUE;
+    }
+
+    subscriber->fd = subscriber_fd;
+    subscriber->watch = g_unix_fd_add(subscriber_fd, G_IO_IN | G_IO_HUP | G_IO_ERR, export_readable, subscriber);
+    subscriber_count++;
+    LOG_I("%s/%s: Export subscriber %zu connected", __FILE__, __FUNCTION__, subscriber_count);
+
+    return G_SOURCE_CONTINUE;
+}
+
+bool export_configure(const char *path)
+{
+    struct sockaddr_un address = {0};
+
+    export_stop();
+    if (NULL == path || '\0' == *path)
+    {
+        return true;
+    }
+    if (sizeof(address.sun_path) <= strlen(path))
+    {
+        LOG_E("%s/%s: Export socket path '%s' is too long", __FILE__, __FUNCTION__, path);
+        return false;
+    }
+
+    address.sun_family = AF_UNIX;
+    g_strlcpy(address.sun_path, path, sizeof(address.sun_path));
+
+    // A socket left by an earlier run would make the bind fail
+    (void)unlink(path);
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (0 > listen_fd || 0 != bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) ||
+        0 != listen(listen_fd, EXPORT_BACKLOG))
+    {
+        LOG_E("%s/%s: Cannot listen on '%s' (%s)", __FILE__, __FUNCTION__, path, strerror(errno));
+        if (0 <= listen_fd)
+        {
+            close(listen_fd);
+            listen_fd = -1;
+        }
+        return false;
+    }
+
+    socket_path = g_strdup(path);
+    listen_watch = g_unix_fd_add(listen_fd, G_IO_IN, export_accept, NULL);
+    LOG_I("%s/%s: Exporting transitions on '%s'", __FILE__, __FUNCTION__, path);
+
+    return true;
+}
+
+void export_records(const evqueue_record_t *records, size_t count)
+{
+    assert(NULL != records || 0 == count);
+
+    if (0 == subscriber_count)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < EXPORT_SUBSCRIBERS_MAX; i++)
+    {
+        export_subscriber_t *subscriber = &subscribers[i];
+
+        if (0 == subscriber->watch)
+        {
+            continue;
+        }
+
+        for (size_t j = 0; j < count; j++)
+        {
+            // The latest state matters most, a full ring loses its oldest
+            if (EXPORT_RING_SIZE == subscriber->head - subscriber->tail)
+            {
+                subscriber->tail++;
+                subscriber->dropped++;
+            }
+            subscriber->ring[subscriber->head++ & EXPORT_RING_MASK] = (export_record_t){
+                EXPORT_TRANSITION,
+                records[j].active,
+                records[j].profile,
+                0,
+                records[j].timestamp,
+                records[j].received};
+        }
+        export_flush(subscriber);
+    }
+}
+
+void export_stop(void)
+{
+    for (size_t i = 0; i < EXPORT_SUBSCRIBERS_MAX; i++)
+    {
+        if (0 != subscribers[i].watch)
+        {
+            export_close(&subscribers[i]);
+        }
+    }
+
+    if (0 != listen_watch)
+    {
+        g_source_remove(listen_watch);
+        listen_watch = 0;
+    }
+    if (0 <= listen_fd)
+    {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+    if (NULL != socket_path)
+    {
+        (void)unlink(socket_path);
+        g_free(socket_path);
+        socket_path = NULL;
+    }
+}
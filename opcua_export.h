@@ -0,0 +1,80 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_EXPORT_H_
+#define _OPCUA_EXPORT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "opcua_evqueue.h"
+
+/*
+ * Local change stream of the axevent transitions for on-camera consumers
+ * that do not want an OPC UA client stack. Subscribers connect to a Unix
+ * domain SOCK_SEQPACKET socket and receive one message per record, taken
+ * from the records handed to the OPC UA server thread, i.e. before
+ * debouncing.
+ *
+ * Every message starts with its kind. A profile is announced once per
+ * subscriber with an export_profile_t before its first transition, after
+ * that it is only referred to by its id. The records are in host byte order.
+ *
+ * Every subscriber has a ring of its own. When a subscriber does not keep
+ * up its oldest records are dropped, and the next record sent tells how
+ * many were dropped so far. Subscribers beyond EXPORT_SUBSCRIBERS_MAX are
+ * closed right away.
+ *
+ * Belongs to the GLib main loop.
+ */
+
+#define EXPORT_SUBSCRIBERS_MAX 8
+#define EXPORT_RING_SIZE 256 // records, a power of two
+#define EXPORT_NAME_SIZE 124
+
+typedef enum
+{
+    EXPORT_TRANSITION = 1,
+    EXPORT_PROFILE = 2,
+} export_kind_t;
+
+typedef struct
+{
+    uint8_t kind; // EXPORT_TRANSITION
+    uint8_t active;
+    uint16_t profile;
+    uint32_t dropped; // records dropped for this subscriber so far
+    int64_t timestamp; // axevent time, unix epoch us
+    int64_t received; // CLOCK_MONOTONIC ns the axevent reached the bridge
+} export_record_t;
+
+typedef struct
+{
+    uint8_t kind; // EXPORT_PROFILE
+    uint8_t length;
+    uint16_t profile;
+    char name[EXPORT_NAME_SIZE]; // "<source>.<label>", not terminated
+} export_profile_t;
+
+_Static_assert(24 == sizeof(export_record_t), "export record layout changed");
+_Static_assert(128 == sizeof(export_profile_t), "export profile layout changed");
+
+bool export_configure(const char *path);
+void export_records(const evqueue_record_t *records, size_t count);
+void export_stop(void);
+
+#endif /* _OPCUA_EXPORT_H_ */
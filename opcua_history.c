@@ -0,0 +1,329 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <open62541/plugin/historydatabase.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opcua_common.h"
+#include "opcua_history.h"
+#include "opcua_profiles.h"
+
+_Static_assert(
+    HISTORY_MEMORY_MAX >= (size_t)PROFILES_MAX * HISTORY_DEPTH_MAX * sizeof(history_entry_t),
+    "history depth exceeds the memory budget");
+
+typedef struct
+{
+    history_entry_t *entries;
+    uint32_t capacity;
+    uint64_t first; // sequence number of the oldest transition kept
+    uint64_t written; // sequence number of the next transition
+} history_ring_t;
+
+static history_ring_t rings[PROFILES_MAX];
+static atomic_uint_least32_t requested_depth;
+static uint32_t depth;
+
+// The oldest transition that fits into capacity entries, slots of a grown
+// ring that were never written stay out of the range
+static uint64_t history_oldest(const history_ring_t *ring, uint32_t capacity)
+{
+    return (ring->written - ring->first > capacity) ? ring->written - capacity : ring->first;
+}
+
+static bool history_resize(history_ring_t *ring, uint32_t capacity)
+{
+    history_entry_t *entries = NULL;
+    uint64_t first = history_oldest(ring, capacity);
+
+    if (0 < capacity)
+    {
+        entries = calloc(capacity, sizeof(*entries));
+        if (NULL == entries)
+        {
+            LOG_E("%s/%s: Failed to allocate %u history entries", __FILE__, __FUNCTION__, capacity);
+            return false;
+        }
+
+        // Keep the newest transitions, each at the index of its sequence number
+        for (uint64_t seq = first; seq < ring->written; seq++)
+        {
+            entries[seq % capacity] = ring->entries[seq % ring->capacity];
+        }
+    }
+    free(ring->entries);
+    ring->entries = entries;
+    ring->capacity = capacity;
+    ring->first = first;
+
+    return true;
+}
+
+void history_configure(uint32_t new_depth)
+{
+    assert(HISTORY_DEPTH_MAX >= new_depth);
+
+    // Picked up by the server thread on its next drain round
+    atomic_store(&requested_depth, new_depth);
+}
+
+void history_update(void)
+{
+    uint32_t new_depth = atomic_load(&requested_depth);
+
+    if (new_depth == depth)
+    {
+        return;
+    }
+    depth = new_depth;
+    for (size_t id = 0; id < PROFILES_MAX; id++)
+    {
+        if (0 < rings[id].capacity)
+        {
+            (void)history_resize(&rings[id], depth);
+        }
+    }
+    LOG_I("%s/%s: Keeping %u transitions per profile", __FILE__, __FUNCTION__, depth);
+}
+
+void history_record(int id, UA_Boolean state, UA_DateTime source_timestamp)
+{
+    assert(0 <= id && PROFILES_MAX > id);
+
+    history_ring_t *ring = &rings[id];
+
+    if (0 == depth || (depth != ring->capacity && !history_resize(ring, depth)))
+    {
+        return;
+    }
+
+    // A profile carried over to a restarted server records its last
+    // transition again
+    history_entry_t *entry = &ring->entries[(ring->written + ring->capacity - 1) % ring->capacity];
+    if (ring->first < ring->written && entry->state == state && entry->source_timestamp == source_timestamp)
+    {
+        return;
+    }
+
+    entry = &ring->entries[ring->written % ring->capacity];
+    entry->source_timestamp = source_timestamp;
+    entry->server_timestamp = UA_DateTime_now();
+    entry->state = state;
+    ring->written++;
+    ring->first = history_oldest(ring, ring->capacity);
+}
+
+static int history_lookup(const UA_NodeId *node_id)
+{
+    size_t count = profiles_count();
+
+    if (1 != node_id->namespaceIndex || UA_NODEIDTYPE_STRING != node_id->identifierType)
+    {
+        return -1;
+    }
+
+    // Profile nodes are named "<source>.<label>" after the profile index
+    for (size_t id = 0; id < count; id++)
+    {
+        const char *name = profiles_node_name(id);
+
+        if (strlen(name) == node_id->identifier.string.length &&
+            0 == memcmp(name, node_id->identifier.string.data, node_id->identifier.string.length))
+        {
+            return (int)id;
+        }
+    }
+    return -1;
+}
+
+static UA_StatusCode history_set_value(
+    UA_DataValue *value,
+    const history_entry_t *entry,
+    UA_TimestampsToReturn timestamps)
+{
+    UA_StatusCode status = UA_Variant_setScalarCopy(&value->value, &entry->state, &UA_TYPES[UA_TYPES_BOOLEAN]);
+
+    value->hasValue = (UA_STATUSCODE_GOOD == status);
+    if (UA_TIMESTAMPSTORETURN_SOURCE == timestamps || UA_TIMESTAMPSTORETURN_BOTH == timestamps)
+    {
+        value->sourceTimestamp = entry->source_timestamp;
+        value->hasSourceTimestamp = true;
+    }
+    if (UA_TIMESTAMPSTORETURN_SERVER == timestamps || UA_TIMESTAMPSTORETURN_BOTH == timestamps)
+    {
+        value->serverTimestamp = entry->server_timestamp;
+        value->hasServerTimestamp = true;
+    }
+    return status;
+}
+
+static UA_StatusCode history_read_node(
+    const UA_ReadRawModifiedDetails *details,
+    UA_TimestampsToReturn timestamps,
+    const UA_HistoryReadValueId *node,
+    UA_HistoryReadResult *result,
+    UA_HistoryData *data)
+{
+    int id = history_lookup(&node->nodeId);
+    if (0 > id)
+    {
+        return UA_STATUSCODE_BADNODEIDUNKNOWN;
+    }
+
+    // An unspecified end time reads forward from the start time, an
+    // unspecified start time backward from the end time
+    const history_ring_t *ring = &rings[id];
+    UA_DateTime low = (0 == details->startTime) ? INT64_MIN : details->startTime;
+    UA_DateTime high = (0 == details->endTime) ? INT64_MAX : details->endTime;
+    bool reverse = (low > high) || (0 == details->startTime && 0 != details->endTime);
+    if (low > high)
+    {
+        UA_DateTime swap = low;
+        low = high;
+        high = swap;
+    }
+
+    uint64_t oldest = ring->first;
+    uint64_t seq = reverse ? ring->written - 1 : oldest;
+    if (0 < node->continuationPoint.length)
+    {
+        if (sizeof(seq) != node->continuationPoint.length)
+        {
+            return UA_STATUSCODE_BADCONTINUATIONPOINTINVALID;
+        }
+        memcpy(&seq, node->continuationPoint.data, sizeof(seq));
+        if (seq < oldest || seq >= ring->written)
+        {
+            return UA_STATUSCODE_BADCONTINUATIONPOINTINVALID;
+        }
+    }
+    if (oldest == ring->written)
+    {
+        return UA_STATUSCODE_GOODNODATA;
+    }
+
+    uint64_t remaining = reverse ? seq - oldest + 1 : ring->written - seq;
+    size_t limit = (0 == details->numValuesPerNode) ? HISTORY_DEPTH_MAX : details->numValuesPerNode;
+    size_t size = remaining < limit ? remaining : limit;
+    UA_DataValue *values = UA_Array_new(size, &UA_TYPES[UA_TYPES_DATAVALUE]);
+    UA_StatusCode status = UA_STATUSCODE_GOOD;
+    size_t count = 0;
+
+    if (NULL == values)
+    {
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    for (; 0 < remaining && UA_STATUSCODE_GOOD == status; remaining--, seq = reverse ? seq - 1 : seq + 1)
+    {
+        const history_entry_t *entry = &ring->entries[seq % ring->capacity];
+        UA_DateTime time =
+            (UA_TIMESTAMPSTORETURN_SERVER == timestamps) ? entry->server_timestamp : entry->source_timestamp;
+
+        if (time < low || time > high)
+        {
+            continue;
+        }
+
+        // The client picks up where this read stopped with the next request
+        if (count == limit)
+        {
+            status = UA_ByteString_allocBuffer(&result->continuationPoint, sizeof(seq));
+            if (UA_STATUSCODE_GOOD == status)
+            {
+                memcpy(result->continuationPoint.data, &seq, sizeof(seq));
+            }
+            break;
+        }
+        status = history_set_value(&values[count++], entry, timestamps);
+    }
+
+    if (UA_STATUSCODE_GOOD != status || 0 == count)
+    {
+        UA_Array_delete(values, size, &UA_TYPES[UA_TYPES_DATAVALUE]);
+        return (UA_STATUSCODE_GOOD == status) ? UA_STATUSCODE_GOODNODATA : status;
+    }
+    data->dataValues = values;
+    data->dataValuesSize = count;
+
+    return UA_STATUSCODE_GOOD;
+}
+
+static void history_read_raw(
+    UA_Server *server,
+    void *context,
+    const UA_NodeId *session_id,
+    void *session_context,
+    const UA_RequestHeader *request_header,
+    const UA_ReadRawModifiedDetails *details,
+    UA_TimestampsToReturn timestamps,
+    UA_Boolean release_continuation_points,
+    size_t count,
+    const UA_HistoryReadValueId *nodes,
+    UA_HistoryReadResponse *response,
+    UA_HistoryData *const *const data)
+{
+    (void)server;
+    (void)context;
+    (void)session_id;
+    (void)session_context;
+    (void)request_header;
+
+    // Continuation points hold no resources, releasing them is a no-op
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!release_continuation_points)
+        {
+            response->results[i].statusCode =
+                history_read_node(details, timestamps, &nodes[i], &response->results[i], data[i]);
+        }
+    }
+}
+
+static void history_clear(UA_HistoryDatabase *database)
+{
+    (void)database;
+
+    for (size_t id = 0; id < PROFILES_MAX; id++)
+    {
+        free(rings[id].entries);
+    }
+    memset(rings, 0, sizeof(rings));
+}
+
+void history_stop(void)
+{
+    history_clear(NULL);
+}
+
+void history_init(UA_Server *server)
+{
+    assert(NULL != server);
+
+    UA_ServerConfig *config = UA_Server_getConfig(server);
+    UA_HistoryDatabase database;
+
+    // The rings are also freed along with the server configuration
+    memset(&database, 0, sizeof(database));
+    database.clear = history_clear;
+    database.readRaw = history_read_raw;
+    config->historyDatabase = database;
+    config->accessHistoryDataCapability = true;
+    config->maxReturnDataValues = HISTORY_DEPTH_MAX;
+}
@@ -0,0 +1,57 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_HISTORY_H_
+#define _OPCUA_HISTORY_H_
+
+#include <open62541/server.h>
+#include <stdint.h>
+
+/*
+ * Bounded in-memory history of the published transitions of every profile,
+ * served to clients through HistoryRead (raw). Each profile gets a ring of
+ * the configured depth when its first transition is recorded, so at most
+ * PROFILES_MAX * depth * sizeof(history_entry_t) bytes are ever held. Once
+ * a ring is full its oldest transitions are overwritten.
+ *
+ * Reads longer than numValuesPerNode return a continuation point holding the
+ * sequence number of the next transition, which stays valid until that
+ * transition is overwritten.
+ *
+ * history_configure may be called from any thread, the rest belongs to the
+ * OPC UA server thread. history_stop frees every ring before the server is
+ * deleted.
+ */
+
+// Every profile may fill its ring, the depth is capped so that all of them
+// together stay within HISTORY_MEMORY_MAX bytes
+#define HISTORY_MEMORY_MAX (16 * 1024 * 1024)
+#define HISTORY_DEPTH_MAX 2048
+
+typedef struct
+{
+    UA_DateTime source_timestamp;
+    UA_DateTime server_timestamp;
+    UA_Boolean state;
+} history_entry_t;
+
+void history_configure(uint32_t depth);
+void history_init(UA_Server *server);
+void history_update(void);
+void history_record(int id, UA_Boolean state, UA_DateTime source_timestamp);
+void history_stop(void);
+
+#endif /* _OPCUA_HISTORY_H_ */
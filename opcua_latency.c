@@ -0,0 +1,265 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+
+#include "opcua_common.h"
+#include "opcua_latency.h"
+
+// Writes waiting for the end of the current server iteration
+#define LATENCY_PENDING_MAX 1024
+
+typedef enum
+{
+    LATENCY_FIELD_COUNT,
+    LATENCY_FIELD_P50,
+    LATENCY_FIELD_P99,
+    LATENCY_FIELD_P999,
+    LATENCY_FIELD_MAX,
+    LATENCY_FIELD_BUCKETS,
+    LATENCY_FIELDS,
+} latency_field_t;
+
+typedef struct
+{
+    uint64_t buckets[LATENCY_BUCKETS];
+    uint64_t count;
+    uint64_t max;
+} latency_histogram_t;
+
+// Node context of every exposed variable
+typedef struct
+{
+    latency_stage_t stage;
+    latency_field_t field;
+} latency_node_t;
+
+static char *stage_names[LATENCY_STAGES] = {"Event", "Queue", "Iterate"};
+static char *field_names[LATENCY_FIELDS] = {"Count", "P50", "P99", "P999", "Max", "Buckets"};
+
+static latency_histogram_t histograms[LATENCY_STAGES];
+static latency_node_t nodes[LATENCY_STAGES][LATENCY_FIELDS];
+static int64_t pending[LATENCY_PENDING_MAX];
+static size_t pending_count;
+
+static unsigned int latency_bucket(uint64_t us)
+{
+    // Bucket 0 holds 0 us, bucket n holds [2^(n-1), 2^n) us
+    unsigned int bucket = (0 == us) ? 0 : 64 - __builtin_clzll(us);
+
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+void latency_record(latency_stage_t stage, int64_t us)
+{
+    assert(LATENCY_STAGES > stage);
+
+    latency_histogram_t *histogram = &histograms[stage];
+    uint64_t value = (0 > us) ? 0 : (uint64_t)us;
+
+    histogram->buckets[latency_bucket(value)]++;
+    histogram->count++;
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+}
+
+void latency_written(int64_t received_ns, int64_t written_ns)
+{
+    latency_record(LATENCY_QUEUE, (written_ns - received_ns) / 1000);
+
+    if (LATENCY_PENDING_MAX > pending_count)
+    {
+        pending[pending_count++] = written_ns;
+    }
+}
+
+void latency_iterated(int64_t now_ns)
+{
+    for (size_t i = 0; i < pending_count; i++)
+    {
+        latency_record(LATENCY_ITERATE, (now_ns - pending[i]) / 1000);
+    }
+    pending_count = 0;
+}
+
+uint64_t latency_percentile(latency_stage_t stage, double percentile)
+{
+    assert(LATENCY_STAGES > stage);
+
+    const latency_histogram_t *histogram = &histograms[stage];
+    uint64_t rank = (uint64_t)(histogram->count * percentile / 100.0);
+    uint64_t seen = 0;
+
+    if (0 == histogram->count)
+    {
+        return 0;
+    }
+
+    // Report the upper bound of the bucket holding the requested rank
+    for (unsigned int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        seen += histogram->buckets[bucket];
+        if (seen > rank)
+        {
+            uint64_t bound = (0 == bucket) ? 0 : (1ULL << bucket) - 1;
+            return bound < histogram->max ? bound : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+static UA_StatusCode latency_read(
+    UA_Server *server,
+    const UA_NodeId *session_id,
+    void *session_context,
+    const UA_NodeId *node_id,
+    void *node_context,
+    UA_Boolean source_timestamp,
+    const UA_NumericRange *range,
+    UA_DataValue *value)
+{
+    const latency_node_t *node = node_context;
+    const latency_histogram_t *histogram = &histograms[node->stage];
+    UA_UInt64 number = 0;
+
+    (void)server;
+    (void)session_id;
+    (void)session_context;
+    (void)node_id;
+    (void)source_timestamp;
+    (void)range;
+
+    value->hasValue = true;
+    switch (node->field)
+    {
+    case LATENCY_FIELD_COUNT:
+        number = histogram->count;
+        break;
+    case LATENCY_FIELD_P50:
+        number = latency_percentile(node->stage, 50.0);
+        break;
+    case LATENCY_FIELD_P99:
+        number = latency_percentile(node->stage, 99.0);
+        break;
+    case LATENCY_FIELD_P999:
+        number = latency_percentile(node->stage, 99.9);
+        break;
+    case LATENCY_FIELD_MAX:
+        number = histogram->max;
+        break;
+    default:
+        return UA_Variant_setArrayCopy(
+            &value->value,
+            histogram->buckets,
+            LATENCY_BUCKETS,
+            &UA_TYPES[UA_TYPES_UINT64]);
+    }
+    return UA_Variant_setScalarCopy(&value->value, &number, &UA_TYPES[UA_TYPES_UINT64]);
+}
+
+static UA_StatusCode latency_add_object(UA_Server *server, UA_NodeId parent, char *name, UA_NodeId *node_id)
+{
+    UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", name);
+
+    return UA_Server_addObjectNode(
+        server,
+        UA_NODEID_NULL,
+        parent,
+        UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+        UA_QUALIFIEDNAME(1, name),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+        attr,
+        NULL,
+        node_id);
+}
+
+UA_StatusCode latency_add_nodes(UA_Server *server)
+{
+    assert(NULL != server);
+
+    UA_DataSource source = {latency_read, NULL};
+    UA_NodeId latency_id;
+    UA_StatusCode status;
+
+    status = latency_add_object(server, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER), "Latency", &latency_id);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        return status;
+    }
+
+    for (int stage = 0; stage < LATENCY_STAGES && UA_STATUSCODE_GOOD == status; stage++)
+    {
+        UA_NodeId stage_id = UA_NODEID_NULL;
+
+        status = latency_add_object(server, latency_id, stage_names[stage], &stage_id);
+        for (int field = 0; field < LATENCY_FIELDS && UA_STATUSCODE_GOOD == status; field++)
+        {
+            UA_VariableAttributes attr = UA_VariableAttributes_default;
+
+            nodes[stage][field].stage = stage;
+            nodes[stage][field].field = field;
+
+            attr.displayName = UA_LOCALIZEDTEXT("en-US", field_names[field]);
+            attr.description = UA_LOCALIZEDTEXT("en-US", "Latency in microseconds");
+            attr.dataType = UA_TYPES[UA_TYPES_UINT64].typeId;
+            attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+            if (LATENCY_FIELD_BUCKETS == field)
+            {
+                attr.description = UA_LOCALIZEDTEXT("en-US", "Count per power of two microseconds");
+                attr.valueRank = UA_VALUERANK_ONE_DIMENSION;
+            }
+
+            status = UA_Server_addDataSourceVariableNode(
+                server,
+                UA_NODEID_NULL,
+                stage_id,
+                UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                UA_QUALIFIEDNAME(1, field_names[field]),
+                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                attr,
+                source,
+                &nodes[stage][field],
+                NULL);
+        }
+        UA_NodeId_clear(&stage_id);
+    }
+    UA_NodeId_clear(&latency_id);
+
+    return status;
+}
+
+void latency_log_summary(void)
+{
+    for (int stage = 0; stage < LATENCY_STAGES; stage++)
+    {
+        const latency_histogram_t *histogram = &histograms[stage];
+
+        LOG_I(
+            "%s/%s: %s latency (us) count %llu p50 %llu p99 %llu p999 %llu max %llu",
+            __FILE__,
+            __FUNCTION__,
+            stage_names[stage],
+            (unsigned long long)histogram->count,
+            (unsigned long long)latency_percentile(stage, 50.0),
+            (unsigned long long)latency_percentile(stage, 99.0),
+            (unsigned long long)latency_percentile(stage, 99.9),
+            (unsigned long long)histogram->max);
+    }
+}
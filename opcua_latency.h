@@ -0,0 +1,61 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_LATENCY_H_
+#define _OPCUA_LATENCY_H_
+
+#include <open62541/server.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Latency histograms of the alarm path, kept by the OPC UA server thread:
+ *
+ * - event:    axevent timestamp to receipt in the axevent callback
+ * - queue:    receipt to node write, including any debounce hold time
+ * - iterate:  node write to the end of the server iteration that follows
+ *             it. Notifications are only sent once the publishing interval
+ *             of a subscription elapses, which is not part of this stage.
+ *
+ * Buckets are powers of two in microseconds.
+ */
+
+#define LATENCY_BUCKETS 25
+
+typedef enum
+{
+    LATENCY_EVENT,
+    LATENCY_QUEUE,
+    LATENCY_ITERATE,
+    LATENCY_STAGES,
+} latency_stage_t;
+
+static inline int64_t latency_now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void latency_record(latency_stage_t stage, int64_t us);
+void latency_written(int64_t received_ns, int64_t written_ns);
+void latency_iterated(int64_t now_ns);
+uint64_t latency_percentile(latency_stage_t stage, double percentile);
+UA_StatusCode latency_add_nodes(UA_Server *server);
+void latency_log_summary(void);
+
+#endif /* _OPCUA_LATENCY_H_ */
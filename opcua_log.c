@@ -0,0 +1,300 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "opcua_log.h"
+
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+#define LOG_IDLE_TIMEOUT_S 1
+
+_Static_assert(0 == (LOG_RING_SIZE & LOG_RING_MASK), "LOG_RING_SIZE must be a power of two");
+
+/*
+ * Bounded multi-producer/single-consumer ring, each slot carries a sequence
+ * number telling whether it is free for the producer at that position or
+ * ready for the consumer.
+ */
+typedef struct
+{
+    atomic_size_t seq;
+    int level;
+    char msg[LOG_MSG_SIZE];
+} log_slot_t;
+
+static log_slot_t ring[LOG_RING_SIZE];
+static atomic_size_t head;
+static size_t tail;
+
+static pthread_t flusher_thread_id;
+static sem_t flusher_wakeup;
+static atomic_bool flusher_sleeping;
+static atomic_bool active;
+static atomic_bool running;
+
+static atomic_int level_max = LOG_INFO;
+static atomic_uint event_rate = 10;
+static atomic_llong event_window;
+static atomic_uint event_count;
+
+static atomic_uint_fast64_t written;
+static atomic_uint_fast64_t dropped;
+static atomic_uint_fast64_t suppressed;
+static uint64_t reported_drops;
+
+static void log_sync(int level, const char *msg)
+{
+    syslog(level, "%s", msg);
+    printf("%s\n", msg);
+}
+
+static size_t log_flush(void)
+{
+    size_t count = 0;
+
+    for (;;)
+    {
+        log_slot_t *slot = &ring[tail & LOG_RING_MASK];
+
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != tail + 1)
+        {
+            break;
+        }
+
+        syslog(slot->level, "%s", slot->msg);
+        fputs(slot->msg, stdout);
+        fputc('\n', stdout);
+
+        // Hand the slot back to the producers for the next lap
+        atomic_store_explicit(&slot->seq, tail + LOG_RING_SIZE, memory_order_release);
+        tail++;
+        count++;
+    }
+
+    if (0 < count)
+    {
+        fflush(stdout);
+    }
+
+    uint64_t drops = atomic_load_explicit(&dropped, memory_order_relaxed);
+    if (drops != reported_drops)
+    {
+        syslog(
+            LOG_WARNING,
+            "Log ring full, %llu messages dropped (total %llu)",
+            (unsigned long long)(drops - reported_drops),
+            (unsigned long long)drops);
+        reported_drops = drops;
+    }
+
+    return count;
+}
+
+static void *log_flusher(void *data)
+{
+    (void)data;
+
+    while (atomic_load(&running))
+    {
+        if (0 < log_flush())
+        {
+            continue;
+        }
+
+        // Announce that we are going to sleep, then check once more so a
+        // message published in between is not left waiting for the timeout
+        atomic_store(&flusher_sleeping, true);
+        if (atomic_load_explicit(&ring[tail & LOG_RING_MASK].seq, memory_order_acquire) == tail + 1)
+        {
+            atomic_store(&flusher_sleeping, false);
+            continue;
+        }
+
+        struct timespec timeout;
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_sec += LOG_IDLE_TIMEOUT_S;
+        (void)sem_timedwait(&flusher_wakeup, &timeout);
+        atomic_store(&flusher_sleeping, false);
+    }
+
+    (void)log_flush();
+    return NULL;
+}
+
+bool log_start(void)
+{
+    assert(!atomic_load(&active));
+
+    for (size_t i = 0; i < LOG_RING_SIZE; i++)
+    {
+        atomic_init(&ring[i].seq, i);
+    }
+    atomic_store(&head, 0);
+    tail = 0;
+
+    if (0 != sem_init(&flusher_wakeup, 0, 0))
+    {
+        return false;
+    }
+
+    atomic_store(&running, true);
+    if (0 != pthread_create(&flusher_thread_id, NULL, log_flusher, NULL))
+    {
+        atomic_store(&running, false);
+        sem_destroy(&flusher_wakeup);
+        return false;
+    }
+
+    atomic_store(&active, true);
+    return true;
+}
+
+void log_stop(void)
+{
+    if (!atomic_load(&active))
+    {
+        return;
+    }
+
+    // Later messages are written synchronously, the flusher drains the rest
+    atomic_store(&active, false);
+    atomic_store(&running, false);
+    sem_post(&flusher_wakeup);
+    pthread_join(flusher_thread_id, NULL);
+    (void)log_flush();
+    sem_destroy(&flusher_wakeup);
+}
+
+void log_write(int level, const char *fmt, ...)
+{
+    va_list args;
+
+    if (!log_enabled(level))
+    {
+        return;
+    }
+
+    if (!atomic_load_explicit(&active, memory_order_acquire))
+    {
+        char msg[LOG_MSG_SIZE];
+
+        va_start(args, fmt);
+        (void)vsnprintf(msg, sizeof(msg), fmt, args);
+        va_end(args);
+        log_sync(level, msg);
+        return;
+    }
+
+    // Claim a slot, or drop the message if the flusher is a full lap behind
+    size_t pos = atomic_load_explicit(&head, memory_order_relaxed);
+    log_slot_t *slot;
+
+    for (;;)
+    {
+        slot = &ring[pos & LOG_RING_MASK];
+        intptr_t diff = (intptr_t)(atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+
+        if (0 == diff)
+        {
+            if (atomic_compare_exchange_weak_explicit(
+                    &head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (0 > diff)
+        {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&head, memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    va_start(args, fmt);
+    (void)vsnprintf(slot->msg, sizeof(slot->msg), fmt, args);
+    va_end(args);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    atomic_fetch_add_explicit(&written, 1, memory_order_relaxed);
+
+    if (atomic_exchange(&flusher_sleeping, false))
+    {
+        sem_post(&flusher_wakeup);
+    }
+}
+
+bool log_enabled(int level)
+{
+    return level <= atomic_load_explicit(&level_max, memory_order_relaxed);
+}
+
+bool log_event_allowed(void)
+{
+    unsigned int rate = atomic_load_explicit(&event_rate, memory_order_relaxed);
+    struct timespec now;
+
+    if (0 == rate || !log_enabled(LOG_INFO))
+    {
+        atomic_fetch_add_explicit(&suppressed, 1, memory_order_relaxed);
+        return false;
+    }
+
+    // Fixed one second windows are plenty for rate limiting log lines
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    if ((long long)now.tv_sec != atomic_load_explicit(&event_window, memory_order_relaxed))
+    {
+        atomic_store_explicit(&event_window, (long long)now.tv_sec, memory_order_relaxed);
+        atomic_store_explicit(&event_count, 0, memory_order_relaxed);
+    }
+
+    if (rate > atomic_fetch_add_explicit(&event_count, 1, memory_order_relaxed))
+    {
+        return true;
+    }
+
+    atomic_fetch_add_explicit(&suppressed, 1, memory_order_relaxed);
+    return false;
+}
+
+void log_set_level(int level)
+{
+    atomic_store(&level_max, level);
+}
+
+void log_set_event_rate(unsigned int per_second)
+{
+    atomic_store(&event_rate, per_second);
+}
+
+void log_get_stats(log_stats_t *stats)
+{
+    assert(NULL != stats);
+
+    stats->written = atomic_load_explicit(&written, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&dropped, memory_order_relaxed);
+    stats->suppressed = atomic_load_explicit(&suppressed, memory_order_relaxed);
+}
@@ -0,0 +1,49 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_LOG_H_
+#define _OPCUA_LOG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Asynchronous logger. Callers format into a preallocated lock-free ring and
+ * a background thread flushes it in batches to syslog and stdout. When the
+ * ring is full messages are dropped and counted rather than waited for.
+ * Before log_start() and after log_stop() messages are written synchronously.
+ */
+
+#define LOG_RING_SIZE 256 // must be a power of two
+#define LOG_MSG_SIZE 256
+
+typedef struct
+{
+    uint64_t written;
+    uint64_t dropped;
+    uint64_t suppressed;
+} log_stats_t;
+
+bool log_start(void);
+void log_stop(void);
+void log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+bool log_enabled(int level);
+bool log_event_allowed(void);
+void log_set_level(int level);
+void log_set_event_rate(unsigned int per_second);
+void log_get_stats(log_stats_t *stats);
+
+#endif /* _OPCUA_LOG_H_ */
@@ -0,0 +1,344 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "opcua_common.h"
+#include "opcua_metadata.h"
+#include "opcua_profiles.h"
+
+#define METADATA_ENTRIES_MAX 16
+#define METADATA_ENTRY_SEPARATOR ","
+#define METADATA_ANY_SOURCE "*"
+#define METADATA_RESERVED_NAME "State"
+
+typedef struct
+{
+    char source[PROFILES_SOURCE_NAME_SIZE];
+    uint8_t name;
+    char key[METADATA_KEY_SIZE];
+    char name_space[METADATA_KEY_SIZE];
+} metadata_entry_t;
+
+static const char *const type_names[METADATA_TYPES] = {"string", "int", "double", "bool", "nice"};
+
+// Interned names, append only
+static char names[METADATA_NAMES_MAX][METADATA_NAME_SIZE];
+static metadata_type_t types[METADATA_NAMES_MAX];
+static size_t name_count;
+
+static metadata_entry_t entries[METADATA_ENTRIES_MAX];
+static size_t entry_count;
+
+// Nice names of every profile, indexed like the keys of its source. They name
+// the fixed values of a key, so they are only decoded again once the
+// configuration changes.
+typedef struct
+{
+    uint32_t generation; // 0 until decoded
+    bool found[METADATA_VALUES_MAX];
+    char strings[METADATA_VALUES_MAX][METADATA_STRING_SIZE];
+} metadata_texts_t;
+
+static metadata_texts_t texts[PROFILES_MAX];
+static uint32_t generation = 1;
+
+static int metadata_intern(const char *name, metadata_type_t type)
+{
+    for (size_t i = 0; i < name_count; i++)
+    {
+        if (0 == strcmp(names[i], name))
+        {
+            // The node of a name keeps the data type it was created with
+            return (types[i] == type) ? (int)i : -1;
+        }
+    }
+
+    if (METADATA_NAMES_MAX == name_count)
+    {
+        return -1;
+    }
+    g_strlcpy(names[name_count], name, METADATA_NAME_SIZE);
+    types[name_count] = type;
+    return (int)name_count++;
+}
+
+static gboolean metadata_valid_name(const char *name)
+{
+    // "State" is the child NodeId of the profile's activation statistics
+    if ('\0' == *name || METADATA_NAME_SIZE <= strlen(name) || 0 == strcmp(METADATA_RESERVED_NAME, name))
+    {
+        return FALSE;
+    }
+    for (const char *c = name; '\0' != *c; c++)
+    {
+        if (!g_ascii_isalnum(*c))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Parses "<source>.<Name>=<key>[@<namespace>][:<type>]" into entry
+static gboolean metadata_parse(gchar *spec, metadata_entry_t *entry)
+{
+    metadata_type_t type = METADATA_STRING;
+    gchar *name;
+    gchar *key;
+    gchar *text;
+    int id;
+
+    key = strchr(spec, '=');
+    if (NULL == key)
+    {
+        return FALSE;
+    }
+    *key++ = '\0';
+
+    // Source names have no dots, the name follows the first one
+    name = strchr(spec, '.');
+    if (NULL == name || name == spec)
+    {
+        return FALSE;
+    }
+    *name++ = '\0';
+
+    text = strchr(key, ':');
+    if (NULL != text)
+    {
+        *text++ = '\0';
+        for (type = 0; type < METADATA_TYPES; type++)
+        {
+            if (0 == strcmp(type_names[type], text))
+            {
+                break;
+            }
+        }
+        if (METADATA_TYPES == type)
+        {
+            return FALSE;
+        }
+    }
+
+    text = strchr(key, '@');
+    if (NULL != text)
+    {
+        *text++ = '\0';
+    }
+
+    if (!metadata_valid_name(name) || '\0' == *key || METADATA_KEY_SIZE <= strlen(key) ||
+        PROFILES_SOURCE_NAME_SIZE <= strlen(spec) || (NULL != text && METADATA_KEY_SIZE <= strlen(text)))
+    {
+        return FALSE;
+    }
+
+    id = metadata_intern(name, type);
+    if (0 > id)
+    {
+        return FALSE;
+    }
+
+    g_strlcpy(entry->source, spec, sizeof(entry->source));
+    entry->name = (uint8_t)id;
+    g_strlcpy(entry->key, key, sizeof(entry->key));
+    g_strlcpy(entry->name_space, (NULL != text) ? text : "", sizeof(entry->name_space));
+    return TRUE;
+}
+
+bool metadata_configure(const char *spec)
+{
+    gchar **items = g_strsplit((NULL != spec) ? spec : "", METADATA_ENTRY_SEPARATOR, -1);
+    gboolean result = TRUE;
+
+    entry_count = 0;
+    generation++;
+    for (gchar **item = items; NULL != *item; item++)
+    {
+        g_strstrip(*item);
+        if ('\0' == **item)
+        {
+            continue;
+        }
+
+        gchar *text = g_strdup(*item);
+        if (METADATA_ENTRIES_MAX == entry_count || !metadata_parse(text, &entries[entry_count]))
+        {
+            LOG_E("%s/%s: Ignoring event metadata '%s'", __FILE__, __FUNCTION__, *item);
+            result = FALSE;
+        }
+        else
+        {
+            entry_count++;
+        }
+        g_free(text);
+    }
+    g_strfreev(items);
+
+    return result;
+}
+
+void metadata_resolve(const char *source, metadata_keys_t *keys)
+{
+    assert(NULL != source);
+    assert(NULL != keys);
+
+    keys->count = 0;
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        const metadata_entry_t *entry = &entries[i];
+
+        if (0 != strcmp(METADATA_ANY_SOURCE, entry->source) && 0 != strcmp(source, entry->source))
+        {
+            continue;
+        }
+        if (METADATA_VALUES_MAX == keys->count)
+        {
+            LOG_E("%s/%s: Too many metadata keys for '%s'", __FILE__, __FUNCTION__, source);
+            break;
+        }
+
+        keys->keys[keys->count].name = entry->name;
+        g_strlcpy(keys->keys[keys->count].key, entry->key, METADATA_KEY_SIZE);
+        g_strlcpy(keys->keys[keys->count].name_space, entry->name_space, METADATA_KEY_SIZE);
+        keys->count++;
+    }
+}
+
+static gboolean metadata_decode_text(
+    const metadata_keys_t *keys,
+    size_t index,
+    const AXEventKeyValueSet *key_value_set,
+    char *string)
+{
+    const gchar *name_space = ('\0' != keys->keys[index].name_space[0]) ? keys->keys[index].name_space : NULL;
+    const gchar *key = keys->keys[index].key;
+    gchar *text = NULL;
+    gboolean found;
+
+    if (METADATA_NICE == types[keys->keys[index].name])
+    {
+        found = ax_event_key_value_set_get_value_nice_name(key_value_set, key, name_space, &text, NULL);
+    }
+    else
+    {
+        found = ax_event_key_value_set_get_string(key_value_set, key, name_space, &text, NULL);
+    }
+    string[0] = '\0';
+    if (NULL != text)
+    {
+        g_strlcpy(string, text, METADATA_STRING_SIZE);
+        g_free(text);
+    }
+    return found;
+}
+
+void metadata_decode(
+    const metadata_keys_t *keys,
+    int profile,
+    const AXEventKeyValueSet *key_value_set,
+    metadata_record_t *record)
+{
+    assert(NULL != keys);
+    assert(0 <= profile && PROFILES_MAX > profile);
+    assert(NULL != key_value_set);
+    assert(NULL != record);
+
+    metadata_texts_t *cached = &texts[profile];
+    bool decode_texts = cached->generation != generation;
+
+    cached->generation = generation;
+    record->count = 0;
+    for (size_t i = 0; i < keys->count; i++)
+    {
+        const gchar *name_space = ('\0' != keys->keys[i].name_space[0]) ? keys->keys[i].name_space : NULL;
+        const gchar *key = keys->keys[i].key;
+        metadata_value_t *value = &record->values[record->count];
+        gboolean found;
+        gboolean boolean;
+        gint integer;
+
+        // Keys missing from an event leave their variable as it was
+        switch (types[keys->keys[i].name])
+        {
+        case METADATA_INT:
+            found = ax_event_key_value_set_get_integer(key_value_set, key, name_space, &integer, NULL);
+            value->integer = integer;
+            break;
+        case METADATA_DOUBLE:
+            found = ax_event_key_value_set_get_double(key_value_set, key, name_space, &value->number, NULL);
+            break;
+        case METADATA_BOOL:
+            found = ax_event_key_value_set_get_boolean(key_value_set, key, name_space, &boolean, NULL);
+            value->boolean = boolean;
+            break;
+        case METADATA_NICE:
+            if (decode_texts)
+            {
+                cached->found[i] = metadata_decode_text(keys, i, key_value_set, cached->strings[i]);
+            }
+            found = cached->found[i];
+            memcpy(value->string, cached->strings[i], METADATA_STRING_SIZE);
+            break;
+        default:
+            found = metadata_decode_text(keys, i, key_value_set, value->string);
+            break;
+        }
+
+        if (found)
+        {
+            value->name = keys->keys[i].name;
+            record->count++;
+        }
+    }
+}
+
+const char *metadata_name(int name)
+{
+    assert(0 <= name && METADATA_NAMES_MAX > name);
+
+    return names[name];
+}
+
+metadata_type_t metadata_type(int name)
+{
+    assert(0 <= name && METADATA_NAMES_MAX > name);
+
+    return types[name];
+}
+
+bool metadata_equal(const metadata_value_t *value, const metadata_value_t *other)
+{
+    assert(NULL != value);
+    assert(NULL != other);
+
+    if (value->name != other->name)
+    {
+        return false;
+    }
+    switch (types[value->name])
+    {
+    case METADATA_INT:
+        return value->integer == other->integer;
+    case METADATA_DOUBLE:
+        return 0 == memcmp(&value->number, &other->number, sizeof(value->number));
+    case METADATA_BOOL:
+        return value->boolean == other->boolean;
+    default:
+        return 0 == strcmp(value->string, other->string);
+    }
+}
@@ -0,0 +1,104 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_METADATA_H_
+#define _OPCUA_METADATA_H_
+
+#include <axevent.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Extraction of axevent keys beyond the active flag, e.g. the nice name of
+ * the profile, into typed child variables of the profile node.
+ *
+ * The configuration is a comma separated list of
+ * "<source>.<Name>=<key>[@<namespace>][:<type>]" entries. <source> is an
+ * event source or "*" for all of them and <type> one of string (default),
+ * int, double, bool or nice, the latter being the nice name of the value.
+ * Every Name is interned once with its type into a small table that is
+ * never shrunk, so the OPC UA server thread may read the name and type of
+ * any id it received through the axevent queue.
+ *
+ * The keys of a source are resolved when it is subscribed, an event then
+ * only decodes those into the fixed size record queued with it. Nice names
+ * describe the profile rather than the event, so they are decoded from the
+ * first event of a profile only and reused until the configuration changes.
+ * Strings and numbers are decoded from every event.
+ *
+ * Everything but metadata_name, metadata_type and metadata_equal runs on the
+ * GLib main loop.
+ */
+
+#define METADATA_NAMES_MAX 32
+#define METADATA_NAME_SIZE 32
+#define METADATA_KEY_SIZE 64
+#define METADATA_VALUES_MAX 4
+#define METADATA_STRING_SIZE 48
+
+typedef enum
+{
+    METADATA_STRING,
+    METADATA_INT,
+    METADATA_DOUBLE,
+    METADATA_BOOL,
+    METADATA_NICE,
+    METADATA_TYPES
+} metadata_type_t;
+
+typedef struct
+{
+    uint8_t name; // interned name id
+    union
+    {
+        int32_t integer;
+        double number;
+        bool boolean;
+        char string[METADATA_STRING_SIZE];
+    };
+} metadata_value_t;
+
+typedef struct
+{
+    uint8_t count;
+    metadata_value_t values[METADATA_VALUES_MAX];
+} metadata_record_t;
+
+// The keys to decode for one event source
+typedef struct
+{
+    size_t count;
+    struct
+    {
+        uint8_t name;
+        char key[METADATA_KEY_SIZE];
+        char name_space[METADATA_KEY_SIZE];
+    } keys[METADATA_VALUES_MAX];
+} metadata_keys_t;
+
+bool metadata_configure(const char *spec);
+void metadata_resolve(const char *source, metadata_keys_t *keys);
+void metadata_decode(
+    const metadata_keys_t *keys,
+    int profile,
+    const AXEventKeyValueSet *key_value_set,
+    metadata_record_t *record);
+const char *metadata_name(int name);
+metadata_type_t metadata_type(int name);
+bool metadata_equal(const metadata_value_t *value, const metadata_value_t *other);
+
+#endif /* _OPCUA_METADATA_H_ */
@@ -15,41 +15,451 @@
  */
 
 #include <open62541/server_config_default.h>
+#include <errno.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "opcua_activity.h"
+#include "opcua_catalog.h"
 #include "opcua_common.h"
+#include "opcua_debounce.h"
+#include "opcua_diagnostics.h"
+#include "opcua_engine.h"
+#include "opcua_evqueue.h"
+#include "opcua_history.h"
+#include "opcua_latency.h"
+#include "opcua_metadata.h"
 #include "opcua_open62541.h"
+#include "opcua_profiles.h"
+#include "opcua_pubsub.h"
+#include "opcua_snapshot.h"
+
+// How much the server thread handles per drain of the axevent queue, so a
+// burst cannot starve client requests. It drains whenever new events wake it
+// and at least every engine wakeup interval.
+#define EVQUEUE_DRAIN_BATCH 64
+#define EVQUEUE_DRAIN_MAX 1024
+
+#define LATENCY_SUMMARY_INTERVAL_MS (5 * 60 * 1000.0)
+
+#define BRIDGE_OBJECT_NAME "Bridge"
+#define SNAPSHOT_OUTPUTS 4
+
+#define CONDITION_SEVERITY 500
+#define CONDITION_NAME_SIZE 160
+
+#define METADATA_NODE_NAME_SIZE 160
+
+typedef struct
+{
+    UA_NodeId node_id;
+    UA_NodeId condition_id;
+    UA_Boolean state;
+    UA_Boolean created;
+    UA_Boolean pubsub_field; // whether the profile is a field of the PubSub data set
+    UA_StatusCode unconfirmed; // status of a restored or declared state until an event confirms it
+    UA_DateTime timestamp; // source timestamp of the published state
+    UA_DateTime raw_timestamp;
+    int64_t raw_received;
+    debounce_state_t debounce;
+    activity_t activity;
+    uint32_t metadata_nodes; // bit per metadata name whose variable exists
+    metadata_record_t metadata; // values last written to those variables
+} ua_profile_t;
 
 static UA_Server *server;
+static uint64_t evqueue_reported_drops;
+static int64_t created_ns;
+static size_t restored_count;
+static UA_UInt64 drain_callback_id;
+static UA_UInt16 listen_port;
+
+// Port to move the server to, 0 when no restart is pending
+static atomic_uint_least16_t restart_port;
+
+// Set by the first wakeup after the server thread last drained the queue,
+// so a burst costs one write. Set until the thread runs, nothing to wake.
+static atomic_bool wakeup_pending = true;
+
+// Told about a server thread that stopped on its own
+static ua_server_failed_t failed_callback;
+
+// Readable while a wakeup has not ended a wait of the server thread yet,
+// see __wrap_select
+static int wakeup_fd = -1;
+static __thread bool wakeup_waiter;
+
+// Node cache indexed by profile id, see opcua_profiles.h
+static ua_profile_t profiles[PROFILES_MAX];
+
+// Whether the folder of an event source exists, indexed by source id
+static UA_Boolean source_folders[PROFILES_SOURCES_MAX];
+
+static void ua_server_evqueue_drain(UA_Server *uaserver, void *data);
+static void ua_server_latency_summary(UA_Server *uaserver, void *data);
+static UA_StatusCode ua_server_update_status(ua_profile_t *profile, UA_Boolean state, UA_DateTime timestamp);
+static void ua_server_setup(const UA_UInt16 port);
+static UA_StatusCode ua_server_create(int id, UA_Boolean state, UA_DateTime timestamp, int64_t received);
+static void ua_server_restore(int id, bool state, int64_t timestamp);
+static void ua_server_declare(int id);
+static void ua_server_undeclare(int id);
+static UA_StatusCode ua_server_add_bridge(void);
+
+static int64_t now_ms(void)
+{
+    return latency_now_ns() / 1000000;
+}
+
+static double elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void ua_server_carry(int id, const ua_profile_t *previous)
+{
+    ua_profile_t *profile = &profiles[id];
+
+    profile->unconfirmed = previous->unconfirmed;
+    if (UA_STATUSCODE_GOOD != ua_server_create(id, previous->state, previous->timestamp, previous->raw_received))
+    {
+        profile->unconfirmed = UA_STATUSCODE_GOOD;
+        return;
+    }
+
+    // Plain data, the activity nodes of the new server point at the same
+    // static entry as before
+    profile->raw_timestamp = previous->raw_timestamp;
+    profile->debounce = previous->debounce;
+    profile->activity = previous->activity;
+}
+
+static UA_StatusCode ua_server_restart(UA_UInt16 port)
+{
+    static ua_profile_t carried[PROFILES_MAX];
+    size_t count = profiles_count();
+    size_t carried_count = 0;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // open62541 cannot start a server a second time, a new one takes over.
+    // Connections are closed, clients open new sessions and subscriptions.
+    // The profiles keep their states and the history rings stay in place.
+    (void)UA_Server_run_shutdown(server);
+    memcpy(carried, profiles, sizeof(carried));
+    UA_Server_getConfig(server)->historyDatabase.clear = NULL;
+    UA_Server_delete(server);
+    server = NULL;
+
+    ua_server_setup(port);
+    for (size_t id = 0; id < count; id++)
+    {
+        if (carried[id].created)
+        {
+            ua_server_carry(id, &carried[id]);
+            carried_count++;
+        }
+    }
+    catalog_update(ua_server_declare, ua_server_undeclare);
+
+    UA_StatusCode status = UA_Server_run_startup(server);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E(
+            "%s/%s: Failed to restart UA server on port %u (%s)",
+            __FILE__,
+            __FUNCTION__,
+            port,
+            UA_StatusCode_name(status));
+        return status;
+    }
+
+    LOG_I(
+        "%s/%s: UA server restarted on port %u with %zu profiles in %.3f ms",
+        __FILE__,
+        __FUNCTION__,
+        port,
+        carried_count,
+        elapsed_ms(&start));
+    return UA_STATUSCODE_GOOD;
+}
+
+static gboolean ua_server_failed_idle(gpointer data)
+{
+    (void)data;
+
+    failed_callback();
+    return G_SOURCE_REMOVE;
+}
+
+static void ua_server_retune(void)
+{
+    UA_StatusCode status =
+        UA_Server_changeRepeatedCallbackInterval(server, drain_callback_id, engine_get(ENGINE_WAKEUP_MS));
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E("%s/%s: Failed to change drain interval (%s)", __FILE__, __FUNCTION__, UA_StatusCode_name(status));
+    }
+}
 
 static void *run_ua_server(void *running)
 {
     assert(NULL != server);
     assert(NULL != running);
 
+    volatile UA_Boolean *keep_running = running;
+
+    wakeup_waiter = true;
     LOG_I("%s/%s: Starting UA server ...", __FILE__, __FUNCTION__);
-    UA_StatusCode status = UA_Server_run(server, running);
-    LOG_I("%s/%s: UA Server exit status: %s", __FILE__, __FUNCTION__, UA_StatusCode_name(status));
+    UA_StatusCode status = UA_Server_run_startup(server);
+    if (UA_STATUSCODE_GOOD == status)
+    {
+        LOG_I(
+            "%s/%s: UA server connectable %.3f ms after creation, %zu profiles restored",
+            __FILE__,
+            __FUNCTION__,
+            (latency_now_ns() - created_ns) / 1e6,
+            restored_count);
+    }
+    while (UA_STATUSCODE_GOOD == status && *keep_running)
+    {
+        UA_UInt16 port = atomic_exchange(&restart_port, 0);
+        bool relisten = false;
+
+        if (engine_update(UA_Server_getConfig(server), &relisten))
+        {
+            ua_server_retune();
+        }
+        // A port that cannot be listened on, e.g. one taken by another
+        // service, sends the server back to the port it had. Should that fail
+        // too the thread stops and the main loop is told.
+        if (0 != port || relisten)
+        {
+            UA_UInt16 previous = listen_port;
+
+            status = ua_server_restart(0 != port ? port : previous);
+            if (UA_STATUSCODE_GOOD != status && previous != listen_port)
+            {
+                LOG_E("%s/%s: Going back to port %u", __FILE__, __FUNCTION__, previous);
+                status = ua_server_restart(previous);
+            }
+            if (UA_STATUSCODE_GOOD != status)
+            {
+                break;
+            }
+        }
+
+        // Cleared before draining, so events queued from here on wake it again
+        if (atomic_exchange(&wakeup_pending, false))
+        {
+            ua_server_evqueue_drain(server, NULL);
+        }
+        (void)UA_Server_run_iterate(server, true);
+
+        // Only the iteration is measured, notifications for these writes
+        // leave with the next publish of their subscriptions
+        latency_iterated(latency_now_ns());
+    }
+
+    // Nothing needs to wake this thread once it is gone
+    atomic_store(&wakeup_pending, true);
+    bool failed = UA_STATUSCODE_GOOD != status;
+    int64_t stopping_ns = latency_now_ns();
+    if (!failed)
+    {
+        status = UA_Server_run_shutdown(server);
+    }
+
+    int64_t closed_ns = latency_now_ns();
+
+    // The server is recreated by a later launch, everything it owns is freed
+    history_stop();
     UA_Server_delete(server);
     server = NULL;
+    LOG_I(
+        "%s/%s: UA Server exit status: %s, sockets closed in %.3f ms, deleted in %.3f ms",
+        __FILE__,
+        __FUNCTION__,
+        UA_StatusCode_name(status),
+        (closed_ns - stopping_ns) / 1e6,
+        (latency_now_ns() - closed_ns) / 1e6);
+
+    // Stopped without being asked to, the main loop joins the thread
+    if (failed)
+    {
+        (void)g_idle_add(ua_server_failed_idle, NULL);
+    }
     return NULL;
 }
 
-void ua_server_init(const UA_UInt16 port)
+static void ua_server_setup(const UA_UInt16 port)
 {
     assert(NULL == server);
     server = UA_Server_new();
     assert(NULL != server);
+
+    // A new server starts with an empty address space
+    for (size_t id = 0; id < PROFILES_MAX; id++)
+    {
+        UA_NodeId_clear(&profiles[id].condition_id);
+    }
+    memset(profiles, 0, sizeof(profiles));
+    memset(source_folders, 0, sizeof(source_folders));
+    catalog_init();
     assert(1024 <= port && 65535 >= port);
-    UA_ServerConfig_setMinimal(UA_Server_getConfig(server), port, NULL);
+    listen_port = port;
+    UA_StatusCode status = engine_setup(UA_Server_getConfig(server), port);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E("%s/%s: Failed to configure UA server (%s)", __FILE__, __FUNCTION__, UA_StatusCode_name(status));
+    }
+    pubsub_init(server);
+    history_init(server);
+
+    // Axevents are queued by the GLib main loop and applied here, on the
+    // thread that owns the server
+    status = UA_Server_addRepeatedCallback(
+        server,
+        ua_server_evqueue_drain,
+        NULL,
+        engine_get(ENGINE_WAKEUP_MS),
+        &drain_callback_id);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E("%s/%s: Failed to add axevent queue callback (%s)", __FILE__, __FUNCTION__, UA_StatusCode_name(status));
+    }
+
+    status = latency_add_nodes(server);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E("%s/%s: Failed to add latency nodes (%s)", __FILE__, __FUNCTION__, UA_StatusCode_name(status));
+    }
+
+    status = diagnostics_add_nodes(server);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E("%s/%s: Failed to add diagnostics nodes (%s)", __FILE__, __FUNCTION__, UA_StatusCode_name(status));
+    }
+
+    status = ua_server_add_bridge();
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E("%s/%s: Failed to add bridge object (%s)", __FILE__, __FUNCTION__, UA_StatusCode_name(status));
+    }
+
+    status = UA_Server_addRepeatedCallback(server, ua_server_latency_summary, NULL, LATENCY_SUMMARY_INTERVAL_MS, NULL);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E("%s/%s: Failed to add latency summary (%s)", __FILE__, __FUNCTION__, UA_StatusCode_name(status));
+    }
+    history_update();
+}
+
+void ua_server_init(const UA_UInt16 port)
+{
+    created_ns = latency_now_ns();
+    ua_server_setup(port);
+
+    // Known and declared profiles are in place before the server accepts its
+    // first connection
+    restored_count = snapshot_load(ua_server_restore);
+    catalog_update(ua_server_declare, ua_server_undeclare);
+}
+
+void ua_server_set_port(const UA_UInt16 port)
+{
+    assert(1024 <= port && 65535 >= port);
+
+    // Picked up by the server thread on its next iteration
+    atomic_store(&restart_port, port);
+}
+
+// open62541 waits for network activity in select(), the bridge is linked
+// with -Wl,--wrap=select so those calls end up here. On the server thread
+// the wakeup eventfd joins the read set. Its counter stays readable until a
+// wait consumes it, so a wakeup written just before select() is entered
+// still ends that wait.
+int __real_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+int __wrap_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+
+int __wrap_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
+{
+    // Clients on other threads, the benchmark's for one, wait as usual
+    if (!wakeup_waiter || 0 > wakeup_fd || NULL == readfds)
+    {
+        return __real_select(nfds, readfds, writefds, exceptfds, timeout);
+    }
+
+    FD_SET(wakeup_fd, readfds);
+    int ready = __real_select(nfds > wakeup_fd ? nfds : wakeup_fd + 1, readfds, writefds, exceptfds, timeout);
+    if (0 < ready && FD_ISSET(wakeup_fd, readfds))
+    {
+        uint64_t count;
+        ssize_t size = read(wakeup_fd, &count, sizeof(count));
+
+        (void)size;
+        ready--;
+    }
+    FD_CLR(wakeup_fd, readfds);
+    return ready;
+}
+
+static void ua_server_notify(void)
+{
+    uint64_t count = 1;
+
+    // Fails only once the counter is close to overflowing, still readable then
+    ssize_t written = write(wakeup_fd, &count, sizeof(count));
+    (void)written;
+}
+
+void ua_server_wakeup(void)
+{
+    // Called by the producer after queueing events
+    if (!atomic_exchange(&wakeup_pending, true))
+    {
+        ua_server_notify();
+    }
 }
 
-bool ua_server_start(pthread_t *thread_id, UA_Boolean *running)
+void ua_server_interrupt(void)
+{
+    // Called after clearing the running flag, the thread is not joined yet
+    ua_server_notify();
+}
+
+bool ua_server_start(pthread_t *thread_id, UA_Boolean *running, ua_server_failed_t failed)
 {
     assert(NULL != server);
     assert(NULL != thread_id);
     assert(NULL != running);
+    assert(NULL != failed);
+
+    // Kept for the life of the process, a restarted server reuses it
+    if (0 > wakeup_fd)
+    {
+        wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (0 > wakeup_fd || FD_SETSIZE <= wakeup_fd)
+        {
+            LOG_E("%s/%s: Failed to create wakeup eventfd: %s", __FILE__, __FUNCTION__, strerror(errno));
+            if (0 <= wakeup_fd)
+            {
+                (void)close(wakeup_fd);
+                wakeup_fd = -1;
+            }
+            return false;
+        }
+    }
 
+    failed_callback = failed;
+    atomic_store(&wakeup_pending, true);
     int result = pthread_create(thread_id, NULL, run_ua_server, (void *)running);
 
     if (0 != result)
@@ -62,10 +472,353 @@ bool ua_server_start(pthread_t *thread_id, UA_Boolean *running)
     return true;
 }
 
-static void ua_server_add_status(char *label, UA_Boolean state)
+static UA_StatusCode ua_server_add_source_folder(int source)
 {
     assert(NULL != server);
-    assert(NULL != label);
+
+    if (source_folders[source])
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+
+    // One folder per event source (topic1), named and identified after it
+    char *name = (char *)profiles_source_name(source);
+    UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+
+    attr.description = UA_LOCALIZEDTEXT("en-US", name);
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", name);
+    attr.eventNotifier = UA_EVENTNOTIFIERTYPE_SUBSCRIBETOEVENTS;
+
+    UA_StatusCode status = UA_Server_addObjectNode(
+        server,
+        UA_NODEID_STRING(1, name),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+        UA_QUALIFIEDNAME(1, name),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+        attr,
+        NULL,
+        NULL);
+
+    // The folder is the source of its profiles' conditions, the notifier
+    // hierarchy makes their events reach subscribers of the Server object
+    if (UA_STATUSCODE_GOOD == status)
+    {
+        status = UA_Server_addReference(
+            server,
+            UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_HASNOTIFIER),
+            UA_EXPANDEDNODEID_STRING(1, name),
+            true);
+    }
+    source_folders[source] = (UA_STATUSCODE_GOOD == status);
+
+    return status;
+}
+
+static UA_StatusCode ua_server_set_condition_state(
+    ua_profile_t *profile,
+    const char *label,
+    UA_Boolean active,
+    UA_DateTime timestamp)
+{
+    char message[CONDITION_NAME_SIZE];
+    UA_LocalizedText text;
+    UA_Variant value;
+    UA_StatusCode status;
+
+    UA_Variant_setScalar(&value, &active, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    status = UA_Server_setConditionVariableFieldProperty(
+        server,
+        profile->condition_id,
+        &value,
+        UA_QUALIFIEDNAME(0, "ActiveState"),
+        UA_QUALIFIEDNAME(0, "Id"));
+
+    text = UA_LOCALIZEDTEXT("en", active ? "Active" : "Inactive");
+    UA_Variant_setScalar(&value, &text, &UA_TYPES[UA_TYPES_LOCALIZEDTEXT]);
+    status |= UA_Server_setConditionField(server, profile->condition_id, &value, UA_QUALIFIEDNAME(0, "ActiveState"));
+
+    (void)snprintf(message, sizeof(message), "%s %s", label, active ? "active" : "inactive");
+    text = UA_LOCALIZEDTEXT("en", message);
+    UA_Variant_setScalar(&value, &text, &UA_TYPES[UA_TYPES_LOCALIZEDTEXT]);
+    status |= UA_Server_setConditionField(server, profile->condition_id, &value, UA_QUALIFIEDNAME(0, "Message"));
+
+    // Only active alarms show up in a ConditionRefresh
+    UA_Variant_setScalar(&value, &active, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    status |= UA_Server_setConditionField(server, profile->condition_id, &value, UA_QUALIFIEDNAME(0, "Retain"));
+
+    UA_Variant_setScalar(&value, &timestamp, &UA_TYPES[UA_TYPES_DATETIME]);
+    status |= UA_Server_setConditionField(server, profile->condition_id, &value, UA_QUALIFIEDNAME(0, "Time"));
+
+    return status;
+}
+
+static UA_StatusCode ua_server_add_condition(ua_profile_t *profile, int id, UA_Boolean active)
+{
+    int source = profiles_source(id);
+    char name[CONDITION_NAME_SIZE];
+    UA_Boolean enabled = true;
+    UA_UInt16 severity = CONDITION_SEVERITY;
+    UA_Variant value;
+    UA_StatusCode status;
+
+    // Named after the profile with an "Alarm" suffix so it does not clash
+    // with the profile variable in the same folder
+    (void)snprintf(name, sizeof(name), "%sAlarm", profiles_label(id));
+    status = UA_Server_createCondition(
+        server,
+        UA_NODEID_NULL,
+        UA_NODEID_NUMERIC(0, UA_NS0ID_ALARMCONDITIONTYPE),
+        UA_QUALIFIEDNAME(1, name),
+        UA_NODEID_STRING(1, (char *)profiles_source_name(source)),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+        &profile->condition_id);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        return status;
+    }
+
+    UA_Variant_setScalar(&value, &enabled, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    status = UA_Server_setConditionVariableFieldProperty(
+        server,
+        profile->condition_id,
+        &value,
+        UA_QUALIFIEDNAME(0, "EnabledState"),
+        UA_QUALIFIEDNAME(0, "Id"));
+
+    UA_Variant_setScalar(&value, &severity, &UA_TYPES[UA_TYPES_UINT16]);
+    status |= UA_Server_setConditionField(server, profile->condition_id, &value, UA_QUALIFIEDNAME(0, "Severity"));
+
+    status |= ua_server_set_condition_state(profile, profiles_label(id), active, profile->timestamp);
+
+    return status;
+}
+
+static UA_StatusCode ua_server_fire_condition(ua_profile_t *profile, int id, UA_Boolean active, UA_DateTime timestamp)
+{
+    assert(NULL != server);
+    assert(NULL != profile);
+
+    // No condition means the profile is only published as a variable
+    if (UA_NodeId_isNull(&profile->condition_id))
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+
+    UA_StatusCode status = ua_server_set_condition_state(profile, profiles_label(id), active, timestamp);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        return status;
+    }
+
+    return UA_Server_triggerConditionEvent(
+        server,
+        profile->condition_id,
+        UA_NODEID_STRING(1, (char *)profiles_source_name(profiles_source(id))),
+        NULL);
+}
+
+static UA_StatusCode ua_server_read_toggles(
+    UA_Server *uaserver,
+    const UA_NodeId *session_id,
+    void *session_context,
+    const UA_NodeId *node_id,
+    void *node_context,
+    UA_Boolean source_timestamp,
+    const UA_NumericRange *range,
+    UA_DataValue *value)
+{
+    const ua_profile_t *profile = node_context;
+
+    (void)uaserver;
+    (void)session_id;
+    (void)session_context;
+    (void)node_id;
+    (void)source_timestamp;
+    (void)range;
+
+    value->hasValue = true;
+    return UA_Variant_setScalarCopy(&value->value, &profile->debounce.toggles, &UA_TYPES[UA_TYPES_UINT32]);
+}
+
+static UA_StatusCode ua_server_read_suppressed(
+    UA_Server *uaserver,
+    const UA_NodeId *session_id,
+    void *session_context,
+    const UA_NodeId *node_id,
+    void *node_context,
+    UA_Boolean source_timestamp,
+    const UA_NumericRange *range,
+    UA_DataValue *value)
+{
+    const ua_profile_t *profile = node_context;
+    UA_UInt32 suppressed = debounce_suppressed(&profile->debounce);
+
+    (void)uaserver;
+    (void)session_id;
+    (void)session_context;
+    (void)node_id;
+    (void)source_timestamp;
+    (void)range;
+
+    value->hasValue = true;
+    return UA_Variant_setScalarCopy(&value->value, &suppressed, &UA_TYPES[UA_TYPES_UINT32]);
+}
+
+static UA_StatusCode ua_server_add_counter(ua_profile_t *profile, char *name, UA_DataSource source)
+{
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", name);
+    attr.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+
+    // Counters are read on demand, they are never written on the event path
+    return UA_Server_addDataSourceVariableNode(
+        server,
+        UA_NODEID_NULL,
+        profile->node_id,
+        UA_NODEID_NUMERIC(0, UA_NS0ID_HASPROPERTY),
+        UA_QUALIFIEDNAME(1, name),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_PROPERTYTYPE),
+        attr,
+        source,
+        profile,
+        NULL);
+}
+
+static UA_StatusCode ua_server_get_snapshot(
+    UA_Server *uaserver,
+    const UA_NodeId *session_id,
+    void *session_context,
+    const UA_NodeId *method_id,
+    void *method_context,
+    const UA_NodeId *object_id,
+    void *object_context,
+    size_t input_size,
+    const UA_Variant *input,
+    size_t output_size,
+    UA_Variant *output)
+{
+    size_t count = profiles_count();
+    UA_String names[PROFILES_MAX];
+    UA_Boolean states[PROFILES_MAX];
+    UA_DateTime timestamps[PROFILES_MAX];
+    UA_DateTime now = UA_DateTime_now();
+    size_t created = 0;
+    UA_StatusCode status;
+
+    (void)uaserver;
+    (void)session_id;
+    (void)session_context;
+    (void)method_id;
+    (void)method_context;
+    (void)object_id;
+    (void)object_context;
+    (void)input_size;
+    (void)input;
+    assert(SNAPSHOT_OUTPUTS == output_size);
+
+    // Called on the server thread between two drains of the axevent queue,
+    // so the table is consistent and no node has to be read
+    for (size_t id = 0; id < count; id++)
+    {
+        if (profiles[id].created)
+        {
+            names[created] = UA_STRING((char *)profiles_node_name(id));
+            states[created] = profiles[id].state;
+            timestamps[created] = profiles[id].timestamp;
+            created++;
+        }
+    }
+
+    status = UA_Variant_setArrayCopy(&output[0], names, created, &UA_TYPES[UA_TYPES_STRING]);
+    status |= UA_Variant_setArrayCopy(&output[1], states, created, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    status |= UA_Variant_setArrayCopy(&output[2], timestamps, created, &UA_TYPES[UA_TYPES_DATETIME]);
+    status |= UA_Variant_setScalarCopy(&output[3], &now, &UA_TYPES[UA_TYPES_DATETIME]);
+
+    return status;
+}
+
+static UA_StatusCode ua_server_add_bridge(void)
+{
+    UA_ObjectAttributes object_attr = UA_ObjectAttributes_default;
+    UA_MethodAttributes method_attr = UA_MethodAttributes_default;
+    UA_Argument outputs[SNAPSHOT_OUTPUTS];
+    static const struct
+    {
+        char *name;
+        char *description;
+        int type;
+        UA_Int32 rank;
+    } output_info[SNAPSHOT_OUTPUTS] = {
+        {"NodeIds", "String NodeIds of the profiles", UA_TYPES_STRING, UA_VALUERANK_ONE_DIMENSION},
+        {"States", "Published state of each profile", UA_TYPES_BOOLEAN, UA_VALUERANK_ONE_DIMENSION},
+        {"Timestamps", "Source timestamp of each state", UA_TYPES_DATETIME, UA_VALUERANK_ONE_DIMENSION},
+        {"SnapshotTime", "Server time of the snapshot", UA_TYPES_DATETIME, UA_VALUERANK_SCALAR},
+    };
+
+    object_attr.displayName = UA_LOCALIZEDTEXT("en-US", BRIDGE_OBJECT_NAME);
+    object_attr.description = UA_LOCALIZEDTEXT("en-US", "Services of the axevent bridge");
+    UA_StatusCode status = UA_Server_addObjectNode(
+        server,
+        UA_NODEID_STRING(1, BRIDGE_OBJECT_NAME),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+        UA_QUALIFIEDNAME(1, BRIDGE_OBJECT_NAME),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+        object_attr,
+        NULL,
+        NULL);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        return status;
+    }
+
+    for (size_t i = 0; i < SNAPSHOT_OUTPUTS; i++)
+    {
+        UA_Argument_init(&outputs[i]);
+        outputs[i].name = UA_STRING(output_info[i].name);
+        outputs[i].description = UA_LOCALIZEDTEXT("en-US", output_info[i].description);
+        outputs[i].dataType = UA_TYPES[output_info[i].type].typeId;
+        outputs[i].valueRank = output_info[i].rank;
+    }
+
+    // The arrays are parallel, entry i of each describes the same profile
+    method_attr.displayName = UA_LOCALIZEDTEXT("en-US", "GetSnapshot");
+    method_attr.description = UA_LOCALIZEDTEXT("en-US", "States of all profiles, taken at once");
+    method_attr.executable = true;
+    method_attr.userExecutable = true;
+    return UA_Server_addMethodNode(
+        server,
+        UA_NODEID_STRING(1, BRIDGE_OBJECT_NAME ".GetSnapshot"),
+        UA_NODEID_STRING(1, BRIDGE_OBJECT_NAME),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+        UA_QUALIFIEDNAME(1, "GetSnapshot"),
+        method_attr,
+        ua_server_get_snapshot,
+        0,
+        NULL,
+        SNAPSHOT_OUTPUTS,
+        outputs,
+        NULL,
+        NULL);
+}
+
+static UA_StatusCode ua_server_add_status(ua_profile_t *profile, int id, UA_Boolean state)
+{
+    assert(NULL != server);
+    assert(NULL != profile);
+
+    int source = profiles_source(id);
+    char *label = (char *)profiles_label(id);
+
+    UA_StatusCode status = ua_server_add_source_folder(source);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        return status;
+    }
 
     // Define attributes
     UA_VariableAttributes attr = UA_VariableAttributes_default;
@@ -75,16 +828,19 @@ static void ua_server_add_status(char *label, UA_Boolean state)
     attr.description = UA_LOCALIZEDTEXT("en-US", label);
     attr.displayName = UA_LOCALIZEDTEXT("en-US", label);
     attr.dataType = UA_TYPES[UA_TYPES_BOOLEAN].typeId;
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_HISTORYREAD;
+    attr.historizing = true;
 
-    // Add the variable node to the information model
-    UA_NodeId node_id = UA_NODEID_STRING(1, label);
+    // Add the variable node to the information model, the node id refers to
+    // the "<source>.<label>" name kept by the profile index so it is never
+    // allocated
+    profile->node_id = UA_NODEID_STRING(1, (char *)profiles_node_name(id));
     UA_QualifiedName name = UA_QUALIFIEDNAME(1, label);
-    UA_NodeId parent_node_id = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+    UA_NodeId parent_node_id = UA_NODEID_STRING(1, (char *)profiles_source_name(source));
     UA_NodeId parent_ref_node_id = UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES);
-    UA_Server_addVariableNode(
+    status = UA_Server_addVariableNode(
         server,
-        node_id,
+        profile->node_id,
         parent_node_id,
         parent_ref_node_id,
         name,
@@ -92,50 +848,472 @@ static void ua_server_add_status(char *label, UA_Boolean state)
         attr,
         NULL,
         NULL);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        return status;
+    }
+
+    // Flapping that the debounce stage hides is still visible through these
+    UA_DataSource toggles = {ua_server_read_toggles, NULL};
+    UA_DataSource suppressed = {ua_server_read_suppressed, NULL};
+    (void)ua_server_add_counter(profile, "ToggleCount", toggles);
+    (void)ua_server_add_counter(profile, "SuppressedCount", suppressed);
+
+    // Historians read the activation statistics instead of deriving them
+    status = activity_add_nodes(server, &profile->activity, id);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E(
+            "%s/%s: Failed to add '%s' state object (%s)",
+            __FILE__,
+            __FUNCTION__,
+            profiles_node_name(id),
+            UA_StatusCode_name(status));
+    }
+
+    // Event subscribers get every transition of the alarm condition without
+    // sampling the variable
+    status = ua_server_add_condition(profile, id, state);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E(
+            "%s/%s: Failed to add '%s' alarm condition (%s)",
+            __FILE__,
+            __FUNCTION__,
+            profiles_node_name(id),
+            UA_StatusCode_name(status));
+    }
+
+    return UA_STATUSCODE_GOOD;
 }
 
-static void ua_server_update_status(char *label, UA_Boolean state)
+static UA_StatusCode ua_server_update_status(ua_profile_t *profile, UA_Boolean state, UA_DateTime timestamp)
 {
     assert(NULL != server);
+    assert(NULL != profile);
 
-    UA_Variant newvalue;
-    UA_Variant_setScalar(&newvalue, &state, &UA_TYPES[UA_TYPES_BOOLEAN]);
-    UA_NodeId currentNodeId = UA_NODEID_STRING(1, label);
-    UA_Server_writeValue(server, currentNodeId, newvalue);
+    // Clients get the time the axevent was raised, not the time of the write
+    UA_DataValue newvalue;
+    UA_DataValue_init(&newvalue);
+    UA_Variant_setScalar(&newvalue.value, &state, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    newvalue.hasValue = true;
+    newvalue.sourceTimestamp = timestamp;
+    newvalue.hasSourceTimestamp = true;
+
+    // The alarm may have changed while the bridge was down, or never been seen
+    if (UA_STATUSCODE_GOOD != profile->unconfirmed)
+    {
+        newvalue.status = profile->unconfirmed;
+        newvalue.hasStatus = true;
+    }
+    return UA_Server_writeDataValue(server, profile->node_id, newvalue);
 }
 
-void ua_server_axevent_process(char *label, UA_Boolean state)
+static void ua_server_publish(int id, int64_t now)
 {
-    assert(NULL != server);
+    ua_profile_t *profile = &profiles[id];
+    UA_Boolean state = profile->debounce.raw;
 
-    UA_NodeId reqNodeId = UA_NODEID_STRING(1, label);
-    UA_NodeId resNodeId;
+    // Update the node
+    LOG_EV(
+        "%s/%s: OPC UA updating node '%s' alarm with status '%s' ",
+        __FILE__,
+        __FUNCTION__,
+        profiles_node_name(id),
+        state ? "true" : "false");
 
-    // Check if a node with this label already exists on the OPC UA node store
-    UA_StatusCode ret = UA_Server_readNodeId(server, reqNodeId, &resNodeId);
-    if (UA_STATUSCODE_GOOD == ret) // FOUND
+    profile->unconfirmed = UA_STATUSCODE_GOOD;
+    UA_StatusCode ret = ua_server_update_status(profile, state, profile->raw_timestamp);
+    if (UA_STATUSCODE_GOOD != ret)
     {
-        // Update the node
-        LOG_I(
-            "%s/%s: OPC UA updating node '%s' alarm with status '%s' ",
+        LOG_E(
+            "%s/%s: Failed to publish '%s' alarm (%s)",
             __FILE__,
             __FUNCTION__,
-            label,
-            state ? "true" : "false");
-        ua_server_update_status(label, state);
+            profiles_node_name(id),
+            UA_StatusCode_name(ret));
+        return;
     }
-    else // NOT FOUND
+    profile->state = state;
+    profile->timestamp = profile->raw_timestamp;
+    activity_update(&profile->activity, state, profile->timestamp);
+    debounce_published(&profile->debounce, now);
+    diagnostics_count(DIAGNOSTICS_PUBLISHES);
+    history_record(id, state, profile->timestamp);
+    snapshot_set(id, state, profile->timestamp);
+    latency_written(profile->raw_received, latency_now_ns());
+
+    ret = ua_server_fire_condition(profile, id, state, profile->timestamp);
+    if (UA_STATUSCODE_GOOD != ret)
     {
-        // Create a new node
-        LOG_I(
-            "%s/%s: OPC UA adding node '%s' alarm with status '%s' ",
+        LOG_E(
+            "%s/%s: Failed to fire '%s' alarm event (%s)",
+            __FILE__,
+            __FUNCTION__,
+            profiles_node_name(id),
+            UA_StatusCode_name(ret));
+    }
+}
+
+static UA_StatusCode ua_server_create(int id, UA_Boolean state, UA_DateTime timestamp, int64_t received)
+{
+    ua_profile_t *profile = &profiles[id];
+    const char *label = profiles_node_name(id);
+
+    // Create a new node
+    LOG_EV(
+        "%s/%s: OPC UA adding node '%s' alarm with status '%s' ",
+        __FILE__,
+        __FUNCTION__,
+        label,
+        state ? "true" : "false");
+    profile->timestamp = timestamp;
+    UA_StatusCode ret = ua_server_add_status(profile, id, state);
+    if (UA_STATUSCODE_GOOD == ret)
+    {
+        ret = ua_server_update_status(profile, state, profile->timestamp);
+    }
+    if (UA_STATUSCODE_GOOD != ret)
+    {
+        LOG_E("%s/%s: Failed to publish '%s' alarm (%s)", __FILE__, __FUNCTION__, label, UA_StatusCode_name(ret));
+        return ret;
+    }
+    profile->created = true;
+    diagnostics_count(DIAGNOSTICS_NODES_CREATED);
+    if (!profile->pubsub_field)
+    {
+        profile->pubsub_field = true;
+        pubsub_add_profile(id);
+    }
+    profile->state = state;
+    profile->raw_timestamp = profile->timestamp;
+    profile->raw_received = received;
+    debounce_reset(&profile->debounce, state, now_ms());
+    activity_reset(&profile->activity, state, profile->timestamp);
+    history_record(id, state, profile->timestamp);
+
+    return UA_STATUSCODE_GOOD;
+}
+
+static void ua_server_restore(int id, bool state, int64_t timestamp)
+{
+    // Flagged as uncertain until the first event of the profile confirms it
+    profiles[id].unconfirmed = UA_STATUSCODE_UNCERTAINLASTUSABLEVALUE;
+    if (UA_STATUSCODE_GOOD != ua_server_create(id, state, timestamp, latency_now_ns()))
+    {
+        profiles[id].unconfirmed = UA_STATUSCODE_GOOD;
+    }
+}
+
+static void ua_server_declare(int id)
+{
+    // A restored profile already has a better guess than inactive
+    if (profiles[id].created)
+    {
+        return;
+    }
+
+    profiles[id].unconfirmed = UA_STATUSCODE_UNCERTAININITIALVALUE;
+    if (UA_STATUSCODE_GOOD != ua_server_create(id, false, UA_DateTime_now(), latency_now_ns()))
+    {
+        profiles[id].unconfirmed = UA_STATUSCODE_GOOD;
+    }
+}
+
+static void ua_server_undeclare(int id)
+{
+    ua_profile_t *profile = &profiles[id];
+
+    if (!profile->created)
+    {
+        return;
+    }
+
+    // Children go with their parent, a later event of the profile recreates
+    // all of it
+    (void)UA_Server_deleteCondition(
+        server,
+        profile->condition_id,
+        UA_NODEID_STRING(1, (char *)profiles_source_name(profiles_source(id))));
+    activity_remove_nodes(server, id);
+    UA_StatusCode status = UA_Server_deleteNode(server, profile->node_id, true);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E(
+            "%s/%s: Failed to remove '%s' (%s)",
             __FILE__,
             __FUNCTION__,
-            label,
-            state ? "true" : "false");
-        ua_server_add_status(label, state);
+            profiles_node_name(id),
+            UA_StatusCode_name(status));
+    }
+
+    if (profile->pubsub_field)
+    {
+        pubsub_remove_profile(id);
+        profile->pubsub_field = false;
+    }
+
+    UA_NodeId_clear(&profile->condition_id);
+    profile->created = false;
+    profile->unconfirmed = UA_STATUSCODE_GOOD;
+    profile->metadata_nodes = 0;
+    profile->metadata.count = 0;
+    snapshot_forget(id);
+}
+
+static void ua_server_metadata_variant(const metadata_value_t *value, UA_Variant *variant, UA_String *string)
+{
+    switch (metadata_type(value->name))
+    {
+    case METADATA_INT:
+        UA_Variant_setScalar(variant, (void *)&value->integer, &UA_TYPES[UA_TYPES_INT32]);
+        break;
+    case METADATA_DOUBLE:
+        UA_Variant_setScalar(variant, (void *)&value->number, &UA_TYPES[UA_TYPES_DOUBLE]);
+        break;
+    case METADATA_BOOL:
+        UA_Variant_setScalar(variant, (void *)&value->boolean, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        break;
+    default:
+        *string = UA_STRING((char *)value->string);
+        UA_Variant_setScalar(variant, string, &UA_TYPES[UA_TYPES_STRING]);
+        break;
     }
+}
 
-    // clear
-    UA_NodeId_clear(&resNodeId);
+// The value last written for a metadata name, NULL when there is none
+static metadata_value_t *ua_server_written_metadata(ua_profile_t *profile, uint8_t name)
+{
+    metadata_record_t *written = &profile->metadata;
+
+    for (size_t i = 0; i < written->count; i++)
+    {
+        if (written->values[i].name == name)
+        {
+            return &written->values[i];
+        }
+    }
+    return NULL;
+}
+
+static void ua_server_update_metadata(
+    ua_profile_t *profile,
+    int id,
+    const metadata_record_t *metadata,
+    UA_DateTime timestamp)
+{
+    char node_name[METADATA_NODE_NAME_SIZE];
+    UA_StatusCode status;
+    UA_String string;
+
+    for (size_t i = 0; i < metadata->count; i++)
+    {
+        const metadata_value_t *value = &metadata->values[i];
+        const char *name = metadata_name(value->name);
+        uint32_t bit = UINT32_C(1) << value->name;
+        metadata_value_t *written = ua_server_written_metadata(profile, value->name);
+
+        // Most events repeat the values of the previous one, leave those be
+        if (NULL != written && metadata_equal(written, value))
+        {
+            continue;
+        }
+
+        // "<source>.<label>/<Name>", the node store keeps its own copy
+        (void)snprintf(
+            node_name,
+            sizeof(node_name),
+            "%s%c%s",
+            profiles_node_name(id),
+            PROFILES_CHILD_SEPARATOR,
+            name);
+        UA_NodeId node_id = UA_NODEID_STRING(1, node_name);
+
+        if (0 == (profile->metadata_nodes & bit))
+        {
+            UA_VariableAttributes attr = UA_VariableAttributes_default;
+
+            ua_server_metadata_variant(value, &attr.value, &string);
+            attr.displayName = UA_LOCALIZEDTEXT("en-US", (char *)name);
+            attr.dataType = attr.value.type->typeId;
+            attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+            status = UA_Server_addVariableNode(
+                server,
+                node_id,
+                profile->node_id,
+                UA_NODEID_NUMERIC(0, UA_NS0ID_HASPROPERTY),
+                UA_QUALIFIEDNAME(1, (char *)name),
+                UA_NODEID_NUMERIC(0, UA_NS0ID_PROPERTYTYPE),
+                attr,
+                NULL,
+                NULL);
+            if (UA_STATUSCODE_GOOD != status && UA_STATUSCODE_BADNODEIDEXISTS != status)
+            {
+                LOG_E("%s/%s: Failed to add '%s' (%s)", __FILE__, __FUNCTION__, node_name, UA_StatusCode_name(status));
+                continue;
+            }
+            profile->metadata_nodes |= bit;
+        }
+
+        // Like the state, the value carries the time of the axevent that changed it
+        UA_DataValue newvalue;
+        UA_DataValue_init(&newvalue);
+        ua_server_metadata_variant(value, &newvalue.value, &string);
+        newvalue.hasValue = true;
+        newvalue.sourceTimestamp = timestamp;
+        newvalue.hasSourceTimestamp = true;
+        if (UA_STATUSCODE_GOOD != UA_Server_writeDataValue(server, node_id, newvalue))
+        {
+            continue;
+        }
+        if (NULL == written && METADATA_VALUES_MAX > profile->metadata.count)
+        {
+            written = &profile->metadata.values[profile->metadata.count++];
+        }
+        if (NULL != written)
+        {
+            *written = *value;
+        }
+    }
+}
+
+static void ua_server_axevent_process(const evqueue_record_t *record, int64_t now_ns, int64_t now_us)
+{
+    assert(NULL != server);
+    assert(NULL != record);
+    assert(PROFILES_MAX > record->profile);
+
+    // The label was interned by the producer, no lookup needed
+    int id = record->profile;
+    UA_Boolean state = record->active;
+    ua_profile_t *profile = &profiles[id];
+    UA_DateTime timestamp = UA_DATETIME_UNIX_EPOCH + record->timestamp * UA_DATETIME_USEC;
+    int64_t now = now_ns / 1000000;
+
+    // Wall clock time of the receipt, derived from how long ago it happened
+    int64_t received_us = now_us - (now_ns - record->received) / 1000;
+    latency_record(LATENCY_EVENT, received_us - record->timestamp);
+
+    if (profile->created)
+    {
+        ua_server_update_metadata(profile, id, &record->metadata, timestamp);
+        if (UA_STATUSCODE_GOOD != profile->unconfirmed && profile->debounce.raw == state)
+        {
+            profile->unconfirmed = UA_STATUSCODE_GOOD;
+            (void)ua_server_update_status(profile, profile->state, profile->timestamp);
+        }
+        if (profile->debounce.raw != state)
+        {
+            diagnostics_transition(id);
+            profile->raw_timestamp = timestamp;
+            profile->raw_received = record->received;
+        }
+
+        // The debounce stage decides if and when the transition reaches clients
+        if (debounce_event(&profile->debounce, state, now))
+        {
+            ua_server_publish(id, now);
+        }
+        return;
+    }
+
+    if (UA_STATUSCODE_GOOD != ua_server_create(id, state, timestamp, record->received))
+    {
+        return;
+    }
+    ua_server_update_metadata(profile, id, &record->metadata, timestamp);
+    snapshot_set(id, state, timestamp);
+    latency_written(record->received, latency_now_ns());
+
+    // A profile first seen active is an activation, report it as one
+    if (state)
+    {
+        (void)ua_server_fire_condition(profile, id, state, profile->timestamp);
+    }
+}
+
+static void ua_server_apply_batch(const evqueue_record_t *records, size_t count)
+{
+    // A burst is applied within this server iteration, so subscribers get it
+    // in one publish response; the clocks are read once for all of it
+    int64_t now_ns = latency_now_ns();
+    int64_t now_us = (UA_DateTime_now() - UA_DATETIME_UNIX_EPOCH) / UA_DATETIME_USEC;
+    int64_t done_ns = now_ns;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int64_t start_ns = done_ns;
+
+        // Timed one by one, so the extremes are those of single events
+        ua_server_axevent_process(&records[i], now_ns, now_us);
+        done_ns = latency_now_ns();
+        diagnostics_processed(done_ns - start_ns);
+    }
+}
+
+static void ua_server_debounce_flush(void)
+{
+    size_t count = profiles_count();
+    int64_t now = now_ms();
+
+    // Publish the transitions whose hold time or rate limit has expired
+    for (size_t id = 0; id < count; id++)
+    {
+        if (profiles[id].created && debounce_due(&profiles[id].debounce, now))
+        {
+            ua_server_publish(id, now);
+        }
+    }
+}
+
+static void ua_server_latency_summary(UA_Server *uaserver, void *data)
+{
+    (void)uaserver;
+    (void)data;
+
+    latency_log_summary();
+}
+
+static void ua_server_evqueue_drain(UA_Server *uaserver, void *data)
+{
+    evqueue_record_t records[EVQUEUE_DRAIN_BATCH];
+    evqueue_stats_t stats;
+    int64_t start_ns = latency_now_ns();
+    size_t handled = 0;
+    size_t count;
+
+    (void)uaserver;
+    (void)data;
+
+    // Resize the history rings before recording this round's transitions,
+    // and bring the declared profiles in before their events
+    history_update();
+    catalog_update(ua_server_declare, ua_server_undeclare);
+    do
+    {
+        count = evqueue_pop_batch(records, EVQUEUE_DRAIN_BATCH);
+        ua_server_apply_batch(records, count);
+        handled += count;
+    } while (EVQUEUE_DRAIN_BATCH == count && EVQUEUE_DRAIN_MAX > handled);
+
+    ua_server_debounce_flush();
+    snapshot_update();
+
+    // New profiles join the published data set in one go per round
+    pubsub_update(uaserver);
+    diagnostics_iteration(latency_now_ns() - start_ns);
+
+    evqueue_get_stats(&stats);
+    if (stats.dropped != evqueue_reported_drops)
+    {
+        LOG_E(
+            "%s/%s: Axevent queue full, %llu events dropped (depth %zu, high-water %zu, total %llu)",
+            __FILE__,
+            __FUNCTION__,
+            (unsigned long long)(stats.dropped - evqueue_reported_drops),
+            stats.depth,
+            stats.highwater,
+            (unsigned long long)stats.dropped);
+        evqueue_reported_drops = stats.dropped;
+    }
 }
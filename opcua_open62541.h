@@ -18,9 +18,16 @@
 #define _OPCUA_OPEN62541_H_
 
 #include <open62541/server.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+// Called on the GLib main loop when the server thread stopped on an error
+typedef void (*ua_server_failed_t)(void);
 
 void ua_server_init(const UA_UInt16 port);
-bool ua_server_start(pthread_t *thread_id, UA_Boolean *running);
-void ua_server_axevent_process(char *label, UA_Boolean state);
+bool ua_server_start(pthread_t *thread_id, UA_Boolean *running, ua_server_failed_t failed);
+void ua_server_set_port(const UA_UInt16 port);
+void ua_server_wakeup(void);
+void ua_server_interrupt(void);
 
 #endif /* _OPCUA_OPEN62541_H_ */
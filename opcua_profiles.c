@@ -0,0 +1,213 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "opcua_profiles.h"
+
+// Twice the number of profiles keeps the probe sequences short
+#define PROFILES_SLOTS (2 * PROFILES_MAX)
+#define PROFILES_SLOTS_MASK (PROFILES_SLOTS - 1)
+
+_Static_assert(0 == (PROFILES_SLOTS & PROFILES_SLOTS_MASK), "PROFILES_SLOTS must be a power of two");
+
+typedef struct
+{
+    uint32_t hash;
+    uint16_t id; // profile id + 1, 0 marks an empty slot
+} profiles_slot_t;
+
+typedef struct
+{
+    uint16_t offset; // of "<source>.<label>" in the arena
+    uint8_t label;   // offset of the label within that string
+    uint8_t source;
+} profiles_entry_t;
+
+// String NodeIds of the bridge's own objects, next to the source folders
+static const char *const reserved_sources[] = {"Bridge", "Diagnostics"};
+
+static char source_names[PROFILES_SOURCES_MAX][PROFILES_SOURCE_NAME_SIZE];
+static atomic_size_t source_count;
+
+static profiles_slot_t slots[PROFILES_SLOTS];
+static profiles_entry_t entries[PROFILES_MAX];
+static char arena[PROFILES_ARENA_SIZE];
+static size_t arena_used;
+static atomic_size_t count;
+
+int profiles_source_insert(const char *name)
+{
+    assert(NULL != name);
+
+    size_t sources = atomic_load_explicit(&source_count, memory_order_relaxed);
+
+    for (size_t source = 0; source < sources; source++)
+    {
+        if (0 == strcmp(source_names[source], name))
+        {
+            return (int)source;
+        }
+    }
+
+    if (PROFILES_SOURCES_MAX <= sources || PROFILES_SOURCE_NAME_SIZE <= strlen(name))
+    {
+        return -1;
+    }
+
+    // The first "." of a profile's NodeId ends the source name
+    if (NULL != strchr(name, '.') || NULL != strchr(name, PROFILES_CHILD_SEPARATOR))
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(reserved_sources) / sizeof(reserved_sources[0]); i++)
+    {
+        if (0 == strcmp(reserved_sources[i], name))
+        {
+            return -1;
+        }
+    }
+
+    (void)snprintf(source_names[sources], PROFILES_SOURCE_NAME_SIZE, "%s", name);
+    atomic_store_explicit(&source_count, sources + 1, memory_order_release);
+
+    return (int)sources;
+}
+
+const char *profiles_source_name(int source)
+{
+    assert(0 <= source && atomic_load_explicit(&source_count, memory_order_acquire) > (size_t)source);
+
+    return source_names[source];
+}
+
+size_t profiles_source_count(void)
+{
+    return atomic_load_explicit(&source_count, memory_order_acquire);
+}
+
+static uint32_t profiles_hash(int source, const char *label)
+{
+    // FNV-1a, seeded with the source so equal labels of different sources spread
+    uint32_t hash = (2166136261u ^ (uint32_t)source) * 16777619u;
+
+    while ('\0' != *label)
+    {
+        hash ^= (uint8_t)*label++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static profiles_slot_t *profiles_probe(int source, const char *label, uint32_t hash)
+{
+    size_t index = hash & PROFILES_SLOTS_MASK;
+
+    // The table is never more than half full, so an empty slot always ends the probe
+    while (0 != slots[index].id)
+    {
+        const profiles_entry_t *entry = &entries[slots[index].id - 1];
+
+        if (hash == slots[index].hash && source == entry->source &&
+            0 == strcmp(&arena[entry->offset + entry->label], label))
+        {
+            break;
+        }
+        index = (index + 1) & PROFILES_SLOTS_MASK;
+    }
+    return &slots[index];
+}
+
+int profiles_lookup(int source, const char *label)
+{
+    assert(NULL != label);
+
+    profiles_slot_t *slot = profiles_probe(source, label, profiles_hash(source, label));
+
+    return slot->id - 1;
+}
+
+int profiles_insert(int source, const char *label)
+{
+    assert(0 <= source && PROFILES_SOURCES_MAX > source);
+    assert(NULL != label);
+
+    uint32_t hash = profiles_hash(source, label);
+    profiles_slot_t *slot = profiles_probe(source, label, hash);
+
+    if (0 != slot->id)
+    {
+        return slot->id - 1;
+    }
+
+    // "/" separates a profile's NodeId from those of its child nodes
+    if (NULL != strchr(label, PROFILES_CHILD_SEPARATOR))
+    {
+        return -1;
+    }
+
+    size_t id = atomic_load_explicit(&count, memory_order_relaxed);
+    size_t prefix = strlen(source_names[source]) + 1;
+    size_t size = prefix + strlen(label) + 1;
+
+    if (PROFILES_MAX <= id || PROFILES_ARENA_SIZE - arena_used < size)
+    {
+        return -1;
+    }
+
+    // Intern the node name, it is never copied again after this
+    (void)snprintf(&arena[arena_used], size, "%s.%s", source_names[source], label);
+    entries[id].offset = (uint16_t)arena_used;
+    entries[id].label = (uint8_t)prefix;
+    entries[id].source = (uint8_t)source;
+    arena_used += size;
+
+    slot->hash = hash;
+    slot->id = (uint16_t)(id + 1);
+    atomic_store_explicit(&count, id + 1, memory_order_release);
+
+    return (int)id;
+}
+
+int profiles_source(int id)
+{
+    assert(0 <= id && atomic_load_explicit(&count, memory_order_acquire) > (size_t)id);
+
+    return entries[id].source;
+}
+
+const char *profiles_label(int id)
+{
+    assert(0 <= id && atomic_load_explicit(&count, memory_order_acquire) > (size_t)id);
+
+    return &arena[entries[id].offset + entries[id].label];
+}
+
+const char *profiles_node_name(int id)
+{
+    assert(0 <= id && atomic_load_explicit(&count, memory_order_acquire) > (size_t)id);
+
+    return &arena[entries[id].offset];
+}
+
+size_t profiles_count(void)
+{
+    return atomic_load_explicit(&count, memory_order_acquire);
+}
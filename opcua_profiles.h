@@ -0,0 +1,58 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_PROFILES_H_
+#define _OPCUA_PROFILES_H_
+
+#include <stddef.h>
+
+/*
+ * Open addressing (linear probing) index of the analytics profile labels
+ * seen so far. Each distinct (event source, label) pair is interned once
+ * into a fixed string arena and given a small dense id, which is what
+ * travels through the event pipeline and what the OPC UA server uses to
+ * index its node cache. Event sources (topic1) are interned the same way
+ * into a small table of their own; their ids are never reused.
+ *
+ * The arena holds each profile as "<source>.<label>", which doubles as the
+ * string NodeId of its OPC UA node. Source names holding a "." or a "/" are
+ * refused, as are "Bridge" and "Diagnostics", the NodeIds of the bridge's own
+ * objects next to the source folders. Labels holding a "/" are refused, so
+ * the NodeIds of child nodes, "<source>.<label>/<child>", never clash with
+ * those of other profiles.
+ *
+ * Only the axevent producer inserts; other threads may read the names of any
+ * id they received from it.
+ */
+
+#define PROFILES_MAX 256
+#define PROFILES_SOURCES_MAX 16
+#define PROFILES_SOURCE_NAME_SIZE 32
+#define PROFILES_ARENA_SIZE (PROFILES_MAX * 64)
+#define PROFILES_CHILD_SEPARATOR '/'
+
+int profiles_source_insert(const char *name);
+const char *profiles_source_name(int source);
+size_t profiles_source_count(void);
+
+int profiles_lookup(int source, const char *label);
+int profiles_insert(int source, const char *label);
+int profiles_source(int id);
+const char *profiles_label(int id);
+const char *profiles_node_name(int id);
+size_t profiles_count(void);
+
+#endif /* _OPCUA_PROFILES_H_ */
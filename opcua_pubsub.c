@@ -0,0 +1,320 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <open62541/plugin/pubsub_udp.h>
+#include <open62541/server_config_default.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "opcua_common.h"
+#include "opcua_profiles.h"
+#include "opcua_pubsub.h"
+
+#define PUBSUB_TRANSPORT_PROFILE "http://opcfoundation.org/UA-Profile/Transport/pubsub-udp-uadp"
+#define PUBSUB_URL_SIZE 128
+#define PUBSUB_WRITER_GROUP_ID 100
+#define PUBSUB_DATASET_WRITER_ID 1
+
+typedef struct
+{
+    bool enabled;
+    UA_NodeId connection_id;
+    UA_NodeId dataset_id;
+    UA_NodeId group_id;
+    UA_NodeId writer_id;
+    UA_UInt32 publisher_id;
+    // Profile ids in field order, the first published_count are in the data set
+    uint16_t fields[PROFILES_MAX];
+    size_t field_count;
+    size_t published_count;
+} pubsub_state_t;
+
+static pubsub_state_t state;
+
+// Configuration handed over to the server thread
+static pthread_mutex_t request_lock = PTHREAD_MUTEX_INITIALIZER;
+static char request_url[PUBSUB_URL_SIZE];
+static UA_Duration request_interval_ms;
+static atomic_bool request_pending;
+
+void pubsub_request(const char *url, UA_Duration interval_ms)
+{
+    pthread_mutex_lock(&request_lock);
+    (void)snprintf(request_url, sizeof(request_url), "%s", (NULL != url) ? url : "");
+    request_interval_ms = interval_ms;
+    pthread_mutex_unlock(&request_lock);
+
+    atomic_store(&request_pending, true);
+}
+
+static UA_UInt32 pubsub_publisher_id(void)
+{
+    char hostname[64] = "";
+    UA_UInt32 hash = 2166136261u;
+
+    // Subscribers tell cameras on the same group apart by publisher id, the
+    // FNV-1a hash of the host name is stable and unique enough for that
+    (void)gethostname(hostname, sizeof(hostname) - 1);
+    for (const char *c = hostname; '\0' != *c; c++)
+    {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    return hash;
+}
+
+static void pubsub_teardown(UA_Server *server)
+{
+    if (!state.enabled)
+    {
+        return;
+    }
+
+    // Removing the connection also removes its writer group and writer
+    (void)UA_Server_removePubSubConnection(server, state.connection_id);
+    (void)UA_Server_removePublishedDataSet(server, state.dataset_id);
+    state.enabled = false;
+    state.connection_id = UA_NODEID_NULL;
+    state.dataset_id = UA_NODEID_NULL;
+    state.group_id = UA_NODEID_NULL;
+    state.writer_id = UA_NODEID_NULL;
+    state.published_count = 0;
+}
+
+static UA_StatusCode pubsub_add_group(UA_Server *server, const char *url, UA_Duration interval_ms)
+{
+    UA_PubSubConnectionConfig connection;
+    UA_NetworkAddressUrlDataType address = {UA_STRING_NULL, UA_STRING((char *)url)};
+    UA_PublishedDataSetConfig dataset;
+    UA_WriterGroupConfig group;
+    UA_StatusCode status;
+
+    memset(&connection, 0, sizeof(connection));
+    connection.name = UA_STRING("Alarms");
+    connection.transportProfileUri = UA_STRING(PUBSUB_TRANSPORT_PROFILE);
+    connection.enabled = true;
+    UA_Variant_setScalar(&connection.address, &address, &UA_TYPES[UA_TYPES_NETWORKADDRESSURLDATATYPE]);
+    connection.publisherId.numeric = state.publisher_id;
+    status = UA_Server_addPubSubConnection(server, &connection, &state.connection_id);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        return status;
+    }
+
+    memset(&dataset, 0, sizeof(dataset));
+    dataset.publishedDataSetType = UA_PUBSUB_DATASET_PUBLISHEDITEMS;
+    dataset.name = UA_STRING("Alarms");
+    UA_AddPublishedDataSetResult result = UA_Server_addPublishedDataSet(server, &dataset, &state.dataset_id);
+    if (UA_STATUSCODE_GOOD != result.addResult)
+    {
+        return result.addResult;
+    }
+
+    memset(&group, 0, sizeof(group));
+    group.name = UA_STRING("Alarms");
+    group.publishingInterval = interval_ms;
+    group.writerGroupId = PUBSUB_WRITER_GROUP_ID;
+    group.encodingMimeType = UA_PUBSUB_ENCODING_UADP;
+    group.messageSettings.encoding = UA_EXTENSIONOBJECT_DECODED;
+    group.messageSettings.content.decoded.type = &UA_TYPES[UA_TYPES_UADPWRITERGROUPMESSAGEDATATYPE];
+
+    UA_UadpWriterGroupMessageDataType message;
+    UA_UadpWriterGroupMessageDataType_init(&message);
+    message.networkMessageContentMask =
+        (UA_UadpNetworkMessageContentMask)(UA_UADPNETWORKMESSAGECONTENTMASK_PUBLISHERID |
+                                           UA_UADPNETWORKMESSAGECONTENTMASK_GROUPHEADER |
+                                           UA_UADPNETWORKMESSAGECONTENTMASK_WRITERGROUPID |
+                                           UA_UADPNETWORKMESSAGECONTENTMASK_PAYLOADHEADER);
+    group.messageSettings.content.decoded.data = &message;
+    status = UA_Server_addWriterGroup(server, state.connection_id, &group, &state.group_id);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        return status;
+    }
+
+    return UA_Server_setWriterGroupOperational(server, state.group_id);
+}
+
+static UA_StatusCode pubsub_sync(UA_Server *server)
+{
+    UA_DataSetWriterConfig writer;
+    UA_StatusCode status;
+
+    if (!state.enabled || state.published_count == state.field_count)
+    {
+        return UA_STATUSCODE_GOOD;
+    }
+
+    // The writer keeps the last sample of every field for its delta frames,
+    // it is recreated whenever the data set grows
+    if (!UA_NodeId_isNull(&state.writer_id))
+    {
+        (void)UA_Server_removeDataSetWriter(server, state.writer_id);
+        state.writer_id = UA_NODEID_NULL;
+    }
+
+    for (; state.published_count < state.field_count; state.published_count++)
+    {
+        char *name = (char *)profiles_node_name(state.fields[state.published_count]);
+        UA_DataSetFieldConfig field;
+        UA_NodeId field_id;
+
+        memset(&field, 0, sizeof(field));
+        field.dataSetFieldType = UA_PUBSUB_DATASETFIELD_VARIABLE;
+        field.field.variable.fieldNameAlias = UA_STRING(name);
+        field.field.variable.publishParameters.publishedVariable = UA_NODEID_STRING(1, name);
+        field.field.variable.publishParameters.attributeId = UA_ATTRIBUTEID_VALUE;
+        status = UA_Server_addDataSetField(server, state.dataset_id, &field, &field_id).result;
+        if (UA_STATUSCODE_GOOD != status)
+        {
+            return status;
+        }
+    }
+
+    // Fields are sent as data values, which carry the source timestamp
+    memset(&writer, 0, sizeof(writer));
+    writer.name = UA_STRING("Alarms");
+    writer.dataSetWriterId = PUBSUB_DATASET_WRITER_ID;
+    writer.keyFrameCount = PUBSUB_KEYFRAME_COUNT;
+    writer.dataSetFieldContentMask =
+        (UA_DataSetFieldContentMask)(UA_DATASETFIELDCONTENTMASK_STATUSCODE |
+                                     UA_DATASETFIELDCONTENTMASK_SOURCETIMESTAMP);
+    return UA_Server_addDataSetWriter(server, state.group_id, state.dataset_id, &writer, &state.writer_id);
+}
+
+static void pubsub_configure(UA_Server *server, const char *url, UA_Duration interval_ms)
+{
+    bool was_enabled = state.enabled;
+    UA_StatusCode status;
+
+    pubsub_teardown(server);
+    if ('\0' == *url)
+    {
+        if (was_enabled)
+        {
+            LOG_I("%s/%s: PubSub publisher disabled", __FILE__, __FUNCTION__);
+        }
+        return;
+    }
+
+    state.enabled = true;
+    status = pubsub_add_group(server, url, interval_ms);
+    if (UA_STATUSCODE_GOOD == status)
+    {
+        status = pubsub_sync(server);
+    }
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E(
+            "%s/%s: Failed to publish to '%s' (%s)",
+            __FILE__,
+            __FUNCTION__,
+            url,
+            UA_StatusCode_name(status));
+        pubsub_teardown(server);
+        return;
+    }
+
+    LOG_I(
+        "%s/%s: Publishing %zu profiles to '%s' every %.0f ms as publisher %u",
+        __FILE__,
+        __FUNCTION__,
+        state.field_count,
+        url,
+        interval_ms,
+        state.publisher_id);
+}
+
+void pubsub_init(UA_Server *server)
+{
+    assert(NULL != server);
+
+    UA_StatusCode status = UA_ServerConfig_addPubSubTransportLayer(
+        UA_Server_getConfig(server),
+        UA_PubSubTransportLayerUDPMP());
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E("%s/%s: Failed to add PubSub transport (%s)", __FILE__, __FUNCTION__, UA_StatusCode_name(status));
+    }
+
+    // A new server has no profiles yet and gets the last requested setup
+    memset(&state, 0, sizeof(state));
+    state.publisher_id = pubsub_publisher_id();
+    atomic_store(&request_pending, true);
+}
+
+void pubsub_add_profile(int id)
+{
+    assert(PROFILES_MAX > id);
+
+    // Profiles are remembered while disabled too, enabling publishes them all
+    state.fields[state.field_count++] = (uint16_t)id;
+}
+
+void pubsub_remove_profile(int id)
+{
+    assert(0 <= id && PROFILES_MAX > id);
+
+    for (size_t i = 0; i < state.field_count; i++)
+    {
+        if (id != state.fields[i])
+        {
+            continue;
+        }
+        memmove(&state.fields[i], &state.fields[i + 1], (state.field_count - i - 1) * sizeof(state.fields[0]));
+        state.field_count--;
+
+        // Fields cannot be taken out of a data set with writers, the next
+        // update sets the publisher up again with the remaining ones
+        if (state.enabled)
+        {
+            atomic_store(&request_pending, true);
+        }
+        return;
+    }
+}
+
+void pubsub_update(UA_Server *server)
+{
+    assert(NULL != server);
+
+    if (atomic_exchange(&request_pending, false))
+    {
+        char url[PUBSUB_URL_SIZE];
+        UA_Duration interval_ms;
+
+        pthread_mutex_lock(&request_lock);
+        memcpy(url, request_url, sizeof(url));
+        interval_ms = request_interval_ms;
+        pthread_mutex_unlock(&request_lock);
+
+        pubsub_configure(server, url, interval_ms);
+        return;
+    }
+
+    UA_StatusCode status = pubsub_sync(server);
+    if (UA_STATUSCODE_GOOD != status)
+    {
+        LOG_E(
+            "%s/%s: Failed to add profiles to PubSub, publisher disabled (%s)",
+            __FILE__,
+            __FUNCTION__,
+            UA_StatusCode_name(status));
+        pubsub_teardown(server);
+    }
+}
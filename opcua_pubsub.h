@@ -0,0 +1,45 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_PUBSUB_H_
+#define _OPCUA_PUBSUB_H_
+
+#include <open62541/server.h>
+
+/*
+ * Optional OPC UA PubSub publisher sending the state and source timestamp
+ * of every profile as UADP over UDP, typically to a multicast group, so that
+ * any number of subscribers costs the camera nothing extra.
+ *
+ * Each profile is a field of one published data set, in the order the
+ * profiles were discovered. Removing a profile sets the publisher up again
+ * without its field. Data set messages are sent every publishing
+ * interval, as key frames every PUBSUB_KEYFRAME_COUNT messages and as delta
+ * frames holding only the changed fields in between.
+ *
+ * pubsub_request may be called from any thread, the rest belongs to the OPC
+ * UA server thread.
+ */
+
+#define PUBSUB_KEYFRAME_COUNT 10
+
+void pubsub_request(const char *url, UA_Duration interval_ms);
+void pubsub_init(UA_Server *server);
+void pubsub_add_profile(int id);
+void pubsub_remove_profile(int id);
+void pubsub_update(UA_Server *server);
+
+#endif /* _OPCUA_PUBSUB_H_ */
@@ -0,0 +1,369 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "opcua_common.h"
+#include "opcua_latency.h"
+#include "opcua_profiles.h"
+#include "opcua_snapshot.h"
+
+// How often the main loop looks for a pending image to write
+#define SNAPSHOT_WRITE_INTERVAL_S 1
+// State, timestamp and name lengths, the names themselves fit in the arena size
+#define SNAPSHOT_RECORD_SIZE (1 + 8 + 1 + 1)
+#define SNAPSHOT_SIZE_MAX (sizeof(snapshot_header_t) + PROFILES_MAX * SNAPSHOT_RECORD_SIZE + PROFILES_ARENA_SIZE)
+#define SNAPSHOT_LABEL_SIZE 256
+
+_Static_assert(16 == sizeof(snapshot_header_t), "snapshot header layout changed");
+_Static_assert(256 >= PROFILES_SOURCE_NAME_SIZE, "snapshot records hold the source length in a byte");
+
+typedef struct
+{
+    bool known;
+    bool state;
+    int64_t timestamp;
+} snapshot_state_t;
+
+// Owned by the OPC UA server thread once it runs
+static snapshot_state_t states[PROFILES_MAX];
+static bool dirty;
+static int64_t serialized_ms;
+
+// Handed from the server thread to the main loop
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t pending[SNAPSHOT_SIZE_MAX];
+static size_t pending_size;
+
+// Owned by the main loop
+static gchar *snapshot_path;
+static guint write_source;
+static uint8_t image[SNAPSHOT_SIZE_MAX];
+static atomic_bool enabled;
+
+static uint32_t snapshot_checksum(const uint8_t *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t snapshot_serialize(uint8_t *buffer)
+{
+    snapshot_header_t header = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, 0, 0, 0};
+    size_t count = profiles_count();
+    size_t size = sizeof(header);
+
+    for (size_t id = 0; id < count; id++)
+    {
+        const char *source = profiles_source_name(profiles_source(id));
+        const char *label = profiles_label(id);
+        size_t source_length = strlen(source);
+        size_t label_length = strlen(label);
+
+        if (!states[id].known || SNAPSHOT_LABEL_SIZE <= label_length)
+        {
+            continue;
+        }
+
+        buffer[size++] = states[id].state;
+        memcpy(&buffer[size], &states[id].timestamp, sizeof(states[id].timestamp));
+        size += sizeof(states[id].timestamp);
+        buffer[size++] = (uint8_t)source_length;
+        buffer[size++] = (uint8_t)label_length;
+        memcpy(&buffer[size], source, source_length);
+        size += source_length;
+        memcpy(&buffer[size], label, label_length);
+        size += label_length;
+        header.count++;
+    }
+
+    header.size = size - sizeof(header);
+    header.checksum = snapshot_checksum(&buffer[sizeof(header)], header.size);
+    memcpy(buffer, &header, sizeof(header));
+
+    return size;
+}
+
+static bool snapshot_write_all(int fd, const uint8_t *data, size_t size)
+{
+    while (0 < size)
+    {
+        ssize_t written = write(fd, data, size);
+
+        if (0 > written)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool snapshot_write(const uint8_t *data, size_t size)
+{
+    gchar *temp_path = g_strdup_printf("%s.tmp", snapshot_path);
+    gchar *dir_path = g_path_get_dirname(snapshot_path);
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool written = (0 <= fd) && snapshot_write_all(fd, data, size) && 0 == fsync(fd);
+
+    if (0 <= fd && 0 != close(fd))
+    {
+        written = false;
+    }
+
+    // The rename replaces the old snapshot atomically, syncing the directory
+    // makes it survive a power cut
+    if (written && 0 == rename(temp_path, snapshot_path))
+    {
+        int dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+        if (0 <= dir_fd)
+        {
+            (void)fsync(dir_fd);
+            (void)close(dir_fd);
+        }
+    }
+    else
+    {
+        LOG_E("%s/%s: Failed to write '%s' (%s)", __FILE__, __FUNCTION__, snapshot_path, strerror(errno));
+        (void)unlink(temp_path);
+        written = false;
+    }
+
+    g_free(dir_path);
+    g_free(temp_path);
+    return written;
+}
+
+static gboolean snapshot_write_timeout(gpointer data)
+{
+    size_t size;
+
+    (void)data;
+
+    pthread_mutex_lock(&pending_lock);
+    size = pending_size;
+    memcpy(image, pending, size);
+    pending_size = 0;
+    pthread_mutex_unlock(&pending_lock);
+
+    if (0 < size)
+    {
+        (void)snapshot_write(image, size);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void snapshot_configure(const char *path)
+{
+    g_free(snapshot_path);
+    snapshot_path = NULL;
+
+    if (NULL == path || '\0' == *path)
+    {
+        atomic_store(&enabled, false);
+        if (0 != write_source)
+        {
+            g_source_remove(write_source);
+            write_source = 0;
+        }
+        return;
+    }
+
+    snapshot_path = g_strdup(path);
+    atomic_store(&enabled, true);
+    if (0 == write_source)
+    {
+        write_source = g_timeout_add_seconds(SNAPSHOT_WRITE_INTERVAL_S, snapshot_write_timeout, NULL);
+    }
+}
+
+static bool snapshot_valid(const uint8_t *data, size_t size)
+{
+    snapshot_header_t header;
+
+    if (sizeof(header) > size)
+    {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    return SNAPSHOT_MAGIC == header.magic && SNAPSHOT_VERSION == header.version &&
+           size - sizeof(header) == header.size &&
+           snapshot_checksum(&data[sizeof(header)], header.size) == header.checksum;
+}
+
+size_t snapshot_load(snapshot_restore_t restore)
+{
+    assert(NULL != restore);
+
+    GError *error = NULL;
+    gchar *contents = NULL;
+    gsize size = 0;
+    size_t restored = 0;
+
+    if (NULL == snapshot_path)
+    {
+        return 0;
+    }
+
+    if (!g_file_get_contents(snapshot_path, &contents, &size, &error))
+    {
+        // No snapshot is written before the first state change
+        if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        {
+            LOG_E("%s/%s: Failed to read '%s' (%s)", __FILE__, __FUNCTION__, snapshot_path, error->message);
+        }
+        g_error_free(error);
+        return 0;
+    }
+
+    const uint8_t *data = (const uint8_t *)contents;
+    if (!snapshot_valid(data, size))
+    {
+        LOG_E("%s/%s: Ignoring corrupt snapshot '%s'", __FILE__, __FUNCTION__, snapshot_path);
+        g_free(contents);
+        return 0;
+    }
+
+    size_t pos = sizeof(snapshot_header_t);
+    while (SNAPSHOT_RECORD_SIZE <= size - pos)
+    {
+        char source_name[PROFILES_SOURCE_NAME_SIZE + 1];
+        char label[SNAPSHOT_LABEL_SIZE];
+        bool state = 0 != data[pos];
+        int64_t timestamp;
+        size_t source_length = data[pos + 9];
+        size_t label_length = data[pos + 10];
+
+        memcpy(&timestamp, &data[pos + 1], sizeof(timestamp));
+        pos += SNAPSHOT_RECORD_SIZE;
+        // A valid checksum does not make the lengths fit the name buffers
+        if (PROFILES_SOURCE_NAME_SIZE < source_length || SNAPSHOT_LABEL_SIZE - 1 < label_length)
+        {
+            LOG_E("%s/%s: Ignoring oversized names in '%s'", __FILE__, __FUNCTION__, snapshot_path);
+            break;
+        }
+        if (source_length + label_length > size - pos)
+        {
+            break;
+        }
+        memcpy(source_name, &data[pos], source_length);
+        source_name[source_length] = '\0';
+        memcpy(label, &data[pos + source_length], label_length);
+        label[label_length] = '\0';
+        pos += source_length + label_length;
+
+        // Profiles are interned the same way as when their first event arrives
+        int source = profiles_source_insert(source_name);
+        int id = (0 > source) ? -1 : profiles_insert(source, label);
+        if (0 > id)
+        {
+            LOG_E("%s/%s: Cannot restore profile '%s.%s'", __FILE__, __FUNCTION__, source_name, label);
+            continue;
+        }
+
+        states[id].known = true;
+        states[id].state = state;
+        states[id].timestamp = timestamp;
+        restore(id, state, timestamp);
+        restored++;
+    }
+    g_free(contents);
+
+    return restored;
+}
+
+void snapshot_stop(void)
+{
+    size_t size;
+
+    // The server thread is gone, its latest states are written directly.
+    // Otherwise an image it handed over may still wait for the write timeout.
+    pthread_mutex_lock(&pending_lock);
+    if (dirty)
+    {
+        size = snapshot_serialize(image);
+    }
+    else
+    {
+        size = pending_size;
+        memcpy(image, pending, size);
+    }
+    pending_size = 0;
+    pthread_mutex_unlock(&pending_lock);
+
+    if (atomic_load(&enabled) && 0 < size)
+    {
+        (void)snapshot_write(image, size);
+    }
+    dirty = false;
+    snapshot_configure(NULL);
+}
+
+void snapshot_set(int id, bool state, int64_t timestamp)
+{
+    assert(0 <= id && PROFILES_MAX > id);
+
+    states[id].known = true;
+    states[id].state = state;
+    states[id].timestamp = timestamp;
+    dirty = true;
+}
+
+void snapshot_forget(int id)
+{
+    assert(0 <= id && PROFILES_MAX > id);
+
+    // Removed profiles are not restored after a respawn
+    dirty = dirty || states[id].known;
+    states[id].known = false;
+}
+
+void snapshot_update(void)
+{
+    int64_t now_ms = latency_now_ns() / 1000000;
+
+    // Throttled, a flapping alarm costs one write per interval at most
+    if (!dirty || !atomic_load(&enabled) || SNAPSHOT_INTERVAL_MS > now_ms - serialized_ms)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pending_lock);
+    pending_size = snapshot_serialize(pending);
+    pthread_mutex_unlock(&pending_lock);
+    dirty = false;
+    serialized_ms = now_ms;
+}
@@ -0,0 +1,67 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_SNAPSHOT_H_
+#define _OPCUA_SNAPSHOT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Checkpoint of the known profiles and their last published state, so that
+ * a respawned bridge recreates every alarm node before it accepts its first
+ * connection instead of waiting for the next event of each profile.
+ *
+ * The OPC UA server thread serializes the states into a pending image at
+ * most once per SNAPSHOT_INTERVAL_MS, and only after a change. The GLib
+ * main loop writes that image to a temporary file, syncs it and renames it
+ * over the snapshot, so a crash leaves either the old or the new snapshot.
+ *
+ * The file is a snapshot_header_t followed by one record per profile, in
+ * host byte order: state (1 byte), source timestamp as UA_DateTime
+ * (8 bytes), source and label lengths (1 byte each) and the source and
+ * label characters.
+ *
+ * snapshot_configure, snapshot_load and snapshot_stop belong to the GLib
+ * main loop, snapshot_load must run before the server thread is started.
+ * snapshot_set, snapshot_forget and snapshot_update belong to the OPC UA
+ * server thread.
+ */
+
+#define SNAPSHOT_MAGIC 0x4e534d56 // "VMSN"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_INTERVAL_MS 5000
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t size;     // of the records following the header
+    uint32_t checksum; // FNV-1a of the records
+} snapshot_header_t;
+
+typedef void (*snapshot_restore_t)(int id, bool state, int64_t timestamp);
+
+void snapshot_configure(const char *path);
+size_t snapshot_load(snapshot_restore_t restore);
+void snapshot_stop(void);
+void snapshot_set(int id, bool state, int64_t timestamp);
+void snapshot_forget(int id);
+void snapshot_update(void);
+
+#endif /* _OPCUA_SNAPSHOT_H_ */
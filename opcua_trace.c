@@ -0,0 +1,468 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "opcua_axevents.h"
+#include "opcua_common.h"
+#include "opcua_latency.h"
+#include "opcua_profiles.h"
+#include "opcua_trace.h"
+
+// Records are written in blocks, or at least once per flush interval
+#define TRACE_BUFFER_RECORDS 256
+#define TRACE_FLUSH_INTERVAL_S 1
+// Caps a forgotten recording at 64 MiB
+#define TRACE_MAX_RECORDS (1 << 22)
+// Records replayed per main loop dispatch, so that the loop stays responsive
+#define TRACE_REPLAY_BATCH 256
+
+_Static_assert(64 == sizeof(trace_header_t), "trace header layout changed");
+_Static_assert(16 == sizeof(trace_record_t), "trace record layout changed");
+_Static_assert(256 >= PROFILES_SOURCES_MAX, "trace records hold the source in a byte");
+
+typedef struct
+{
+    int fd;
+    FILE *index;
+    int64_t start_ns;
+    uint32_t records;
+    uint32_t buffered;
+    guint flush_source;
+    uint8_t defined[PROFILES_MAX / 8];
+    trace_record_t buffer[TRACE_BUFFER_RECORDS];
+} trace_recorder_t;
+
+typedef struct
+{
+    void *map;
+    size_t map_size;
+    const trace_record_t *records;
+    size_t count;
+    size_t next;
+    size_t skipped;
+    unsigned int speed;
+    int64_t start_ns;
+    guint source_id;
+    gchar *sources[PROFILES_MAX];
+    gchar *labels[PROFILES_MAX];
+} trace_replay_t;
+
+static trace_recorder_t recorder = {.fd = -1};
+static trace_replay_t replay;
+
+static gchar *trace_index_path(const char *path)
+{
+    return g_strdup_printf("%s.idx", path);
+}
+
+static bool trace_write(int fd, const void *data, size_t size)
+{
+    const uint8_t *pos = data;
+
+    while (0 < size)
+    {
+        ssize_t written = write(fd, pos, size);
+
+        if (0 > written)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            return false;
+        }
+        pos += written;
+        size -= written;
+    }
+    return true;
+}
+
+static void trace_record_close(void)
+{
+    if (0 != recorder.flush_source)
+    {
+        g_source_remove(recorder.flush_source);
+    }
+    close(recorder.fd);
+    fclose(recorder.index);
+    memset(&recorder, 0, sizeof(recorder));
+    recorder.fd = -1;
+}
+
+static bool trace_flush(void)
+{
+    // The index goes first, a record must never refer to an unknown profile
+    if (0 != fflush(recorder.index) ||
+        !trace_write(recorder.fd, recorder.buffer, recorder.buffered * sizeof(trace_record_t)))
+    {
+        LOG_E("%s/%s: Failed to write trace, recording stopped: %s", __FILE__, __FUNCTION__, strerror(errno));
+        trace_record_close();
+        return false;
+    }
+
+    recorder.buffered = 0;
+    return true;
+}
+
+static gboolean trace_flush_timeout(gpointer data)
+{
+    (void)data;
+
+    if (0 < recorder.buffered && !trace_flush())
+    {
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static bool trace_record_start(const char *path)
+{
+    assert(0 > recorder.fd);
+
+    gchar *index_path = trace_index_path(path);
+    trace_header_t header = {0};
+
+    recorder.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    recorder.index = fopen(index_path, "w");
+    g_free(index_path);
+    if (0 > recorder.fd || NULL == recorder.index)
+    {
+        LOG_E("%s/%s: Failed to create trace '%s': %s", __FILE__, __FUNCTION__, path, strerror(errno));
+        if (0 <= recorder.fd)
+        {
+            close(recorder.fd);
+        }
+        if (NULL != recorder.index)
+        {
+            fclose(recorder.index);
+        }
+        memset(&recorder, 0, sizeof(recorder));
+        recorder.fd = -1;
+        return false;
+    }
+
+    recorder.start_ns = latency_now_ns();
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(trace_record_t);
+    header.start_realtime_us = g_get_real_time();
+    header.start_monotonic_ns = recorder.start_ns;
+    if (!trace_write(recorder.fd, &header, sizeof(header)))
+    {
+        LOG_E("%s/%s: Failed to write trace '%s': %s", __FILE__, __FUNCTION__, path, strerror(errno));
+        trace_record_close();
+        return false;
+    }
+
+    recorder.flush_source = g_timeout_add_seconds(TRACE_FLUSH_INTERVAL_S, trace_flush_timeout, NULL);
+    LOG_I("%s/%s: Recording axevents to '%s'", __FILE__, __FUNCTION__, path);
+    return true;
+}
+
+static void trace_record_stop(void)
+{
+    if (0 > recorder.fd)
+    {
+        return;
+    }
+
+    if (trace_flush())
+    {
+        LOG_I("%s/%s: Recorded %u axevents", __FILE__, __FUNCTION__, recorder.records);
+        trace_record_close();
+    }
+}
+
+void trace_append(const evqueue_record_t *record, int source)
+{
+    assert(NULL != record);
+
+    if (0 > recorder.fd)
+    {
+        return;
+    }
+
+    if (TRACE_MAX_RECORDS == recorder.records)
+    {
+        LOG_E("%s/%s: Trace reached %u axevents, recording stopped", __FILE__, __FUNCTION__, recorder.records);
+        trace_record_stop();
+        return;
+    }
+
+    uint8_t bit = 1 << (record->profile & 7);
+    if (0 == (recorder.defined[record->profile >> 3] & bit))
+    {
+        fprintf(
+            recorder.index,
+            "%u %s %s\n",
+            record->profile,
+            profiles_source_name(source),
+            profiles_label(record->profile));
+        recorder.defined[record->profile >> 3] |= bit;
+    }
+
+    trace_record_t *entry = &recorder.buffer[recorder.buffered++];
+    entry->offset_ns = record->received - recorder.start_ns;
+    entry->profile = record->profile;
+    entry->source = (uint8_t)source;
+    entry->active = record->active;
+    entry->reserved = 0;
+    recorder.records++;
+
+    if (TRACE_BUFFER_RECORDS == recorder.buffered)
+    {
+        (void)trace_flush();
+    }
+}
+
+static void trace_replay_close(void)
+{
+    if (0 != replay.source_id)
+    {
+        g_source_remove(replay.source_id);
+    }
+    if (NULL != replay.map)
+    {
+        munmap(replay.map, replay.map_size);
+    }
+    for (size_t i = 0; i < PROFILES_MAX; i++)
+    {
+        g_free(replay.sources[i]);
+        g_free(replay.labels[i]);
+    }
+    memset(&replay, 0, sizeof(replay));
+}
+
+static bool trace_replay_load_index(const char *path)
+{
+    gchar *index_path = trace_index_path(path);
+    gchar *contents = NULL;
+    gchar **lines;
+
+    if (!g_file_get_contents(index_path, &contents, NULL, NULL))
+    {
+        LOG_E("%s/%s: Failed to read trace index '%s'", __FILE__, __FUNCTION__, index_path);
+        g_free(index_path);
+        return false;
+    }
+    g_free(index_path);
+
+    lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+    for (gchar **line = lines; NULL != *line; line++)
+    {
+        gchar **fields = g_strsplit(*line, " ", 3);
+
+        if (3 == g_strv_length(fields))
+        {
+            guint64 id = g_ascii_strtoull(fields[0], NULL, 10);
+
+            if (PROFILES_MAX > id)
+            {
+                g_free(replay.sources[id]);
+                g_free(replay.labels[id]);
+                replay.sources[id] = g_strdup(fields[1]);
+                replay.labels[id] = g_strdup(fields[2]);
+            }
+        }
+        g_strfreev(fields);
+    }
+    g_strfreev(lines);
+
+    return true;
+}
+
+static bool trace_replay_map(const char *path)
+{
+    const trace_header_t *header;
+    struct stat st;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (0 > fd)
+    {
+        LOG_E("%s/%s: Failed to open trace '%s': %s", __FILE__, __FUNCTION__, path, strerror(errno));
+        return false;
+    }
+
+    if (0 != fstat(fd, &st) || sizeof(trace_header_t) > (size_t)st.st_size)
+    {
+        LOG_E("%s/%s: Trace '%s' is truncated", __FILE__, __FUNCTION__, path);
+        close(fd);
+        return false;
+    }
+
+    replay.map_size = st.st_size;
+    replay.map = mmap(NULL, replay.map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == replay.map)
+    {
+        LOG_E("%s/%s: Failed to map trace '%s': %s", __FILE__, __FUNCTION__, path, strerror(errno));
+        replay.map = NULL;
+        return false;
+    }
+
+    header = replay.map;
+    if (0 != memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) || TRACE_VERSION != header->version ||
+        sizeof(trace_record_t) != header->record_size)
+    {
+        LOG_E("%s/%s: '%s' is not a version %d trace", __FILE__, __FUNCTION__, path, TRACE_VERSION);
+        return false;
+    }
+
+    // A partly written last record from an interrupted recording is ignored
+    replay.records = (const trace_record_t *)(header + 1);
+    replay.count = (replay.map_size - sizeof(trace_header_t)) / sizeof(trace_record_t);
+    (void)madvise(replay.map, replay.map_size, MADV_SEQUENTIAL);
+
+    return true;
+}
+
+static int64_t trace_replay_due(const trace_record_t *record)
+{
+    return record->offset_ns * 100 / replay.speed;
+}
+
+static bool trace_replay_backlog(void)
+{
+    evqueue_stats_t stats;
+
+    // As fast as possible still means without overrunning the queue
+    evqueue_get_stats(&stats);
+    return EVQUEUE_CAPACITY / 2 <= stats.depth;
+}
+
+static gboolean trace_replay_tick(gpointer data)
+{
+    int64_t elapsed_ns = latency_now_ns() - replay.start_ns;
+    size_t fired = 0;
+    guint delay_ms = 0;
+
+    (void)data;
+
+    replay.source_id = 0;
+    while (replay.next < replay.count && TRACE_REPLAY_BATCH > fired)
+    {
+        const trace_record_t *record = &replay.records[replay.next];
+
+        if ((0 < replay.speed && trace_replay_due(record) > elapsed_ns) ||
+            (0 == replay.speed && trace_replay_backlog()))
+        {
+            break;
+        }
+
+        if (PROFILES_MAX > record->profile && NULL != replay.labels[record->profile])
+        {
+            axevent_inject(replay.sources[record->profile], replay.labels[record->profile], record->active);
+        }
+        else
+        {
+            replay.skipped++;
+        }
+        replay.next++;
+        fired++;
+    }
+
+    if (replay.next == replay.count)
+    {
+        LOG_I(
+            "%s/%s: Replayed %zu axevents in %lld ms, %zu without a profile in the index",
+            __FILE__,
+            __FUNCTION__,
+            replay.count - replay.skipped,
+            (long long)((latency_now_ns() - replay.start_ns) / 1000000),
+            replay.skipped);
+        trace_replay_close();
+        return G_SOURCE_REMOVE;
+    }
+
+    // Sleep until the next record is due, or give the server thread a moment
+    // to catch up when replaying as fast as possible
+    if (0 < replay.speed && TRACE_REPLAY_BATCH > fired)
+    {
+        int64_t wait_ns = trace_replay_due(&replay.records[replay.next]) - (latency_now_ns() - replay.start_ns);
+        delay_ms = (0 < wait_ns) ? (guint)MIN((wait_ns + 999999) / 1000000, G_MAXUINT) : 0;
+    }
+    else if (0 == replay.speed && TRACE_REPLAY_BATCH > fired)
+    {
+        delay_ms = 1;
+    }
+    replay.source_id = g_timeout_add(delay_ms, trace_replay_tick, NULL);
+
+    return G_SOURCE_REMOVE;
+}
+
+static bool trace_replay_start(const char *path, unsigned int speed_percent)
+{
+    assert(NULL == replay.map);
+
+    if (!trace_replay_map(path) || !trace_replay_load_index(path))
+    {
+        trace_replay_close();
+        return false;
+    }
+
+    LOG_I(
+        "%s/%s: Replaying %zu axevents from '%s' at %u%% speed",
+        __FILE__,
+        __FUNCTION__,
+        replay.count,
+        path,
+        speed_percent);
+    replay.speed = speed_percent;
+    replay.start_ns = latency_now_ns();
+    replay.source_id = g_timeout_add(0, trace_replay_tick, NULL);
+
+    return true;
+}
+
+void trace_stop(void)
+{
+    trace_record_stop();
+    if (NULL != replay.map)
+    {
+        LOG_I("%s/%s: Replay stopped after %zu of %zu axevents", __FILE__, __FUNCTION__, replay.next, replay.count);
+        trace_replay_close();
+    }
+}
+
+bool trace_configure(trace_mode_t mode, const char *path, unsigned int speed_percent)
+{
+    trace_stop();
+
+    if (NULL == path || '\0' == *path)
+    {
+        return TRACE_OFF == mode;
+    }
+
+    switch (mode)
+    {
+    case TRACE_RECORD:
+        return trace_record_start(path);
+    case TRACE_REPLAY:
+        return trace_replay_start(path, speed_percent);
+    default:
+        return true;
+    }
+}
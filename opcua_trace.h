@@ -0,0 +1,74 @@
+/**
+ * Copyright (C) 2023 Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OPCUA_TRACE_H_
+#define _OPCUA_TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "opcua_evqueue.h"
+
+/*
+ * Recording and replay of decoded axevents.
+ *
+ * A trace is a fixed size header followed by fixed size records, so it can
+ * be memory mapped and record n found at a known offset. Offsets only grow,
+ * which allows a binary search by time. A small text index next to it,
+ * <trace>.idx, names the source and label of every profile id used in the
+ * trace with one "<id> <source> <label>" line per profile.
+ *
+ * Replay feeds the records back through the axevent callback from the GLib
+ * main loop, at the recorded pace scaled by a speed in percent, or as fast as
+ * the OPC UA server thread keeps up with when the speed is 0.
+ *
+ * Everything here runs on the GLib main loop thread.
+ */
+
+#define TRACE_MAGIC "OPCUATRC"
+#define TRACE_VERSION 1
+
+typedef enum
+{
+    TRACE_OFF,
+    TRACE_RECORD,
+    TRACE_REPLAY,
+} trace_mode_t;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    int64_t start_realtime_us;
+    int64_t start_monotonic_ns;
+    uint8_t reserved[32];
+} trace_header_t;
+
+typedef struct
+{
+    int64_t offset_ns; // monotonic time since the start of the recording
+    uint16_t profile;
+    uint8_t source;
+    uint8_t active;
+    uint32_t reserved;
+} trace_record_t;
+
+bool trace_configure(trace_mode_t mode, const char *path, unsigned int speed_percent);
+void trace_append(const evqueue_record_t *record, int source);
+void trace_stop(void);
+
+#endif /* _OPCUA_TRACE_H_ */
@@ -20,29 +20,76 @@
 #include <pthread.h>
 
 #include "opcua_axevents.h"
+#include "opcua_catalog.h"
 #include "opcua_common.h"
+#include "opcua_debounce.h"
+#include "opcua_engine.h"
+#include "opcua_export.h"
+#include "opcua_history.h"
 #include "opcua_open62541.h"
+#include "opcua_pubsub.h"
+#include "opcua_snapshot.h"
+#include "opcua_trace.h"
 
 static GMainLoop *main_loop = NULL;
 static AXEventHandler *ehandler;
 static AXParameter *axparameter = NULL;
-static gboolean ehandler_running = false;
 static guint uaport = 0;
 static pthread_t ua_server_thread_id;
 static UA_Boolean ua_server_running = false;
 static UA_Server *uaserver = NULL;
+static debounce_mode_t debouncemode = DEBOUNCE_OFF;
+static guint debounceholdms = 0;
+static guint maxpublishrate = 0;
+static trace_mode_t tracemode = TRACE_OFF;
+static gchar *tracefile = NULL;
+static guint replayspeed = 100;
+static gchar *pubsuburl = NULL;
+static guint pubsubinterval = 100;
+
+// Server engine knobs by parameter name, 0 takes the value of the profile
+static const struct
+{
+    const gchar *name;
+    engine_knob_t knob;
+} engine_params[] = {
+    {"minsamplingms", ENGINE_MIN_SAMPLING_MS},
+    {"minpublishingms", ENGINE_MIN_PUBLISHING_MS},
+    {"maxsessions", ENGINE_MAX_SESSIONS},
+    {"maxsubscriptions", ENGINE_MAX_SUBSCRIPTIONS},
+    {"maxmonitoreditems", ENGINE_MAX_MONITORED_ITEMS},
+    {"maxqueuesize", ENGINE_MAX_QUEUE_SIZE},
+    {"maxnotifications", ENGINE_MAX_NOTIFICATIONS},
+    {"maxretransmission", ENGINE_MAX_RETRANSMISSION},
+    {"networkbuffer", ENGINE_NETWORK_BUFFER},
+    {"wakeupms", ENGINE_WAKEUP_MS},
+};
 
 static void open_syslog(const char *app_name)
 {
     openlog(app_name, LOG_PID, LOG_LOCAL4);
+    if (!log_start())
+    {
+        LOG_E("%s/%s: Failed to start log flusher, logging synchronously", __FILE__, __FUNCTION__);
+    }
 }
 
 static void close_syslog(void)
 {
     LOG_I("%s/%s: Exiting!", __FILE__, __FUNCTION__);
+    log_stop();
     closelog();
 }
 
+static void failed_ua_server(void)
+{
+    // The thread is gone or about to be, the next port change launches a new
+    // server
+    LOG_E("%s/%s: UA server stopped, set a free port to start it again", __FILE__, __FUNCTION__);
+    ua_server_running = false;
+    pthread_join(ua_server_thread_id, NULL);
+}
+
 static gboolean launch_ua_server(const guint serverport)
 {
     assert(NULL == uaserver);
@@ -55,7 +102,7 @@ static gboolean launch_ua_server(const guint serverport)
 
     ua_server_running = true;
     LOG_I("%s/%s: Starting UA server ...", __FILE__, __FUNCTION__);
-    if (!ua_server_start(&ua_server_thread_id, &ua_server_running))
+    if (!ua_server_start(&ua_server_thread_id, &ua_server_running, failed_ua_server))
     {
         LOG_E("%s/%s: Failed to start UA server", __FILE__, __FUNCTION__);
         return FALSE;
@@ -66,8 +113,15 @@ static gboolean launch_ua_server(const guint serverport)
 
 static void shutdown_ua_server(void)
 {
-    assert(ua_server_running);
+    // Already joined when it stopped on an error
+    if (!ua_server_running)
+    {
+        return;
+    }
     ua_server_running = false;
+
+    // Without this the server thread notices the flag at its next timeout
+    ua_server_interrupt();
     pthread_join(ua_server_thread_id, NULL);
 }
 
@@ -92,9 +146,11 @@ static void port_callback(const gchar *name, const gchar *value, void *data)
     uaport = newport;
     LOG_I("%s/%s: Axparam '%s' is %u", __FILE__, __FUNCTION__, name, uaport);
 
+    // A running server restarts itself on the new port, keeping its profiles
     if (ua_server_running)
     {
-        shutdown_ua_server();
+        ua_server_set_port(uaport);
+        return;
     }
 
     (void)launch_ua_server(uaport);
@@ -106,18 +162,299 @@ static void evtsource_callback(const gchar *name, const gchar *value, void *data
     assert(NULL != ehandler);
     assert(NULL != value);
 
-    if (ehandler_running)
-    {
-        axevent_teardown(ehandler);
-    }
-
+    // Subscriptions are updated incrementally, sources that stay in the list
+    // are not resubscribed
     LOG_I("%s/%s: Setting up axevent monitor for '%s'...", __FILE__, __FUNCTION__, value);
     if (!axevent_setup(ehandler, value))
     {
         LOG_E("%s/%s: Failed to setup axevent subscription", __FILE__, __FUNCTION__);
     }
+}
+
+static void eventbatching_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    LOG_I("%s/%s: Axparam '%s' is '%s'", __FILE__, __FUNCTION__, name, value);
+    axevent_set_batching(NULL == value || 0 != strcmp("Off", value));
+}
+
+static void eventmetadata_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    // Subscribed sources pick up the new keys right away
+    LOG_I("%s/%s: Axparam '%s' is '%s'", __FILE__, __FUNCTION__, name, value);
+    if (!axevent_set_metadata(value))
+    {
+        LOG_E("%s/%s: Some event metadata entries were ignored", __FILE__, __FUNCTION__);
+    }
+}
+
+static void loglevel_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    if (NULL != value && 0 == strcmp("Error", value))
+    {
+        LOG_I("%s/%s: Axparam '%s' is '%s', only errors are logged from now on", __FILE__, __FUNCTION__, name, value);
+        log_set_level(LOG_ERR);
+    }
+    else
+    {
+        log_set_level(LOG_INFO);
+        LOG_I("%s/%s: Axparam '%s' is '%s'", __FILE__, __FUNCTION__, name, value);
+    }
+}
+
+static void eventlograte_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    /* Translate parameter value to number; atoi can handle NULL */
+    int rate = atoi(value);
+    if (0 > rate)
+    {
+        LOG_E("%s/%s: Axparam illegal value for %s: '%s'", __FILE__, __FUNCTION__, name, value);
+        return;
+    }
+
+    log_set_event_rate(rate);
+    LOG_I("%s/%s: Axparam '%s' is %d", __FILE__, __FUNCTION__, name, rate);
+}
+
+static void debouncemode_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    if (NULL != value && 0 == strcmp("Hold", value))
+    {
+        debouncemode = DEBOUNCE_HOLD;
+    }
+    else if (NULL != value && 0 == strcmp("Falling", value))
+    {
+        debouncemode = DEBOUNCE_FALLING;
+    }
+    else
+    {
+        debouncemode = DEBOUNCE_OFF;
+    }
+
+    LOG_I("%s/%s: Axparam '%s' is '%s'", __FILE__, __FUNCTION__, name, value);
+    debounce_configure(debouncemode, debounceholdms, maxpublishrate);
+}
+
+static void debounce_uint_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    /* Translate parameter value to number; atoi can handle NULL */
+    int number = atoi(value);
+    if (0 > number)
+    {
+        LOG_E("%s/%s: Axparam illegal value for %s: '%s'", __FILE__, __FUNCTION__, name, value);
+        return;
+    }
+
+    if (0 == strcmp("debounceholdms", name))
+    {
+        debounceholdms = number;
+    }
+    else
+    {
+        maxpublishrate = number;
+    }
+
+    LOG_I("%s/%s: Axparam '%s' is %d", __FILE__, __FUNCTION__, name, number);
+    debounce_configure(debouncemode, debounceholdms, maxpublishrate);
+}
+
+static void historydepth_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    /* Translate parameter value to number; atoi can handle NULL */
+    int depth = atoi(value);
+    if (0 > depth || HISTORY_DEPTH_MAX < depth)
+    {
+        LOG_E("%s/%s: Axparam illegal value for %s: '%s'", __FILE__, __FUNCTION__, name, value);
+        return;
+    }
+
+    LOG_I("%s/%s: Axparam '%s' is %d", __FILE__, __FUNCTION__, name, depth);
+    history_configure(depth);
+}
+
+static void engineprofile_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    LOG_I("%s/%s: Axparam '%s' is '%s'", __FILE__, __FUNCTION__, name, value);
+    if (NULL != value && 0 == strcmp("LowLatency", value))
+    {
+        engine_request_profile(ENGINE_LOW_LATENCY);
+    }
+    else if (NULL != value && 0 == strcmp("ManyClients", value))
+    {
+        engine_request_profile(ENGINE_MANY_CLIENTS);
+    }
+    else
+    {
+        engine_request_profile(ENGINE_DEFAULT);
+    }
+}
+
+static void engine_knob_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    /* Translate parameter value to number; atoi can handle NULL */
+    int number = atoi(value);
+    if (0 > number)
+    {
+        LOG_E("%s/%s: Axparam illegal value for %s: '%s'", __FILE__, __FUNCTION__, name, value);
+        return;
+    }
+
+    // Below this open62541 cannot hold a single message chunk
+    if (0 == strcmp("networkbuffer", name) && 0 != number && 8192 > number)
+    {
+        LOG_E("%s/%s: Axparam illegal value for %s: '%s'", __FILE__, __FUNCTION__, name, value);
+        return;
+    }
 
-    ehandler_running = TRUE;
+    for (size_t i = 0; i < G_N_ELEMENTS(engine_params); i++)
+    {
+        if (0 == strcmp(engine_params[i].name, name))
+        {
+            LOG_I("%s/%s: Axparam '%s' is %d", __FILE__, __FUNCTION__, name, number);
+            engine_request_knob(engine_params[i].knob, number);
+            return;
+        }
+    }
+}
+
+static void snapshotfile_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    LOG_I("%s/%s: Axparam '%s' is '%s'", __FILE__, __FUNCTION__, name, value);
+    snapshot_configure(value);
+}
+
+static void eventprofiles_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    // A running server applies the difference on its next drain
+    LOG_I("%s/%s: Axparam '%s' is '%s'", __FILE__, __FUNCTION__, name, value);
+    if (!catalog_configure(value))
+    {
+        LOG_E("%s/%s: Some declared profiles were ignored", __FILE__, __FUNCTION__);
+    }
+    ua_server_wakeup();
+}
+
+static void exportsocket_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    // Connected subscribers are dropped, they reconnect to the new path
+    LOG_I("%s/%s: Axparam '%s' is '%s'", __FILE__, __FUNCTION__, name, value);
+    if (!export_configure(value))
+    {
+        LOG_E("%s/%s: Failed to set up the export socket", __FILE__, __FUNCTION__);
+    }
+}
+
+static void pubsuburl_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    g_free(pubsuburl);
+    pubsuburl = g_strdup(value);
+
+    LOG_I("%s/%s: Axparam '%s' is '%s'", __FILE__, __FUNCTION__, name, value);
+    pubsub_request(pubsuburl, pubsubinterval);
+}
+
+static void pubsubinterval_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    /* Translate parameter value to number; atoi can handle NULL */
+    int interval = atoi(value);
+    if (0 >= interval)
+    {
+        LOG_E("%s/%s: Axparam illegal value for %s: '%s'", __FILE__, __FUNCTION__, name, value);
+        return;
+    }
+
+    pubsubinterval = interval;
+    LOG_I("%s/%s: Axparam '%s' is %d", __FILE__, __FUNCTION__, name, interval);
+    pubsub_request(pubsuburl, pubsubinterval);
+}
+
+static void trace_apply(void)
+{
+    if (!trace_configure(tracemode, tracefile, replayspeed))
+    {
+        LOG_E("%s/%s: Failed to set up axevent trace with '%s'", __FILE__, __FUNCTION__, tracefile);
+    }
+}
+
+static void tracemode_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    if (NULL != value && 0 == strcmp("Record", value))
+    {
+        tracemode = TRACE_RECORD;
+    }
+    else if (NULL != value && 0 == strcmp("Replay", value))
+    {
+        tracemode = TRACE_REPLAY;
+    }
+    else
+    {
+        tracemode = TRACE_OFF;
+    }
+
+    LOG_I("%s/%s: Axparam '%s' is '%s'", __FILE__, __FUNCTION__, name, value);
+    trace_apply();
+}
+
+static void tracefile_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    g_free(tracefile);
+    tracefile = g_strdup(value);
+
+    LOG_I("%s/%s: Axparam '%s' is '%s'", __FILE__, __FUNCTION__, name, value);
+    trace_apply();
+}
+
+static void replayspeed_callback(const gchar *name, const gchar *value, void *data)
+{
+    (void)data;
+
+    /* Translate parameter value to number; atoi can handle NULL */
+    int speed = atoi(value);
+    if (0 > speed)
+    {
+        LOG_E("%s/%s: Axparam illegal value for %s: '%s'", __FILE__, __FUNCTION__, name, value);
+        return;
+    }
+
+    replayspeed = speed;
+    LOG_I("%s/%s: Axparam '%s' is %d", __FILE__, __FUNCTION__, name, speed);
+
+    // Only a running replay picks up the new speed, it restarts from the top
+    if (TRACE_REPLAY == tracemode)
+    {
+        trace_apply();
+    }
 }
 
 static gboolean setup_param(const gchar *name, AXParameterCallback callbackfn)
@@ -171,13 +508,66 @@ static gboolean setup_params(const char *appname)
         return FALSE;
     }
 
+    if (!setup_param("loglevel", loglevel_callback) || !setup_param("eventlograte", eventlograte_callback))
+    {
+        ax_parameter_free(axparameter);
+        return FALSE;
+    }
+
+    if (!setup_param("debouncemode", debouncemode_callback) ||
+        !setup_param("debounceholdms", debounce_uint_callback) ||
+        !setup_param("maxpublishrate", debounce_uint_callback))
+    {
+        ax_parameter_free(axparameter);
+        return FALSE;
+    }
+
+    if (!setup_param("historydepth", historydepth_callback))
+    {
+        ax_parameter_free(axparameter);
+        return FALSE;
+    }
+
+    // Read by the server as it starts, so it must be known before the port
+    if (!setup_param("snapshotfile", snapshotfile_callback) || !setup_param("eventprofiles", eventprofiles_callback) ||
+        !setup_param("engineprofile", engineprofile_callback))
+    {
+        ax_parameter_free(axparameter);
+        return FALSE;
+    }
+    for (size_t i = 0; i < G_N_ELEMENTS(engine_params); i++)
+    {
+        if (!setup_param(engine_params[i].name, engine_knob_callback))
+        {
+            ax_parameter_free(axparameter);
+            return FALSE;
+        }
+    }
+
     if (!setup_param("port", port_callback))
     {
         ax_parameter_free(axparameter);
         return FALSE;
     }
 
-    if (!setup_param("eventsource", evtsource_callback))
+    // The metadata keys are resolved when a source is subscribed
+    if (!setup_param("eventbatching", eventbatching_callback) ||
+        !setup_param("eventmetadata", eventmetadata_callback) || !setup_param("eventsource", evtsource_callback))
+    {
+        ax_parameter_free(axparameter);
+        return FALSE;
+    }
+
+    if (!setup_param("pubsubinterval", pubsubinterval_callback) || !setup_param("pubsuburl", pubsuburl_callback) ||
+        !setup_param("exportsocket", exportsocket_callback))
+    {
+        ax_parameter_free(axparameter);
+        return FALSE;
+    }
+
+    // The mode goes last so that it starts with the final file and speed
+    if (!setup_param("tracefile", tracefile_callback) || !setup_param("replayspeed", replayspeed_callback) ||
+        !setup_param("tracemode", tracemode_callback))
     {
         ax_parameter_free(axparameter);
         return FALSE;
@@ -227,6 +617,7 @@ int main(int argc, char **argv)
     open_syslog(app_name);
 
     int ret = EXIT_SUCCESS;
+    gint64 stopping_us;
     if (!signal_handler_init())
     {
         ret = EXIT_FAILURE;
@@ -265,16 +656,27 @@ int main(int argc, char **argv)
      * Cleanup and controlled shutdown
      */
 exit_param:
+    stopping_us = g_get_monotonic_time();
     LOG_I("%s/%s: Free axparameter handler ...", __FILE__, __FUNCTION__);
     ax_parameter_free(axparameter);
 
+    LOG_I("%s/%s: Stop axevent trace ...", __FILE__, __FUNCTION__);
+    trace_stop();
+    g_free(tracefile);
+    g_free(pubsuburl);
+
     LOG_I("%s/%s: Unsubscribe from axevents ...", __FILE__, __FUNCTION__);
     axevent_teardown(ehandler);
     ax_event_handler_free(ehandler);
+    export_stop();
 
     LOG_I("%s/%s: Shut down UA server ...", __FILE__, __FUNCTION__);
     shutdown_ua_server();
 
+    LOG_I("%s/%s: Write state snapshot ...", __FILE__, __FUNCTION__);
+    snapshot_stop();
+    LOG_I("%s/%s: Stopped in %.3f ms", __FILE__, __FUNCTION__, (g_get_monotonic_time() - stopping_us) / 1e3);
+
     LOG_I("%s/%s: Unreference main loop ...", __FILE__, __FUNCTION__);
     g_main_loop_unref(main_loop);
 exit_syslog: